@@ -0,0 +1,209 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Effects on the master bus. Everything works on blocks of (non
+// interleaved) samples, and all memory is allocated up front so
+// `process()` can run in the audio thread.
+
+// Plain data, so it can be sent to the audio thread in a command
+struct BusParams
+{
+    float volume = 1.0F;
+
+    // Delay is off if time is 0
+    float delay_time = 0.0F;
+    float delay_feedback = 0.4F;
+    float delay_mix = 0.3F;
+
+    // Reverb is off if mix is 0
+    float reverb_room = 0.5F;
+    float reverb_mix = 0.0F;
+
+    // 0 = off, 1 = low pass, 2 = high pass
+    int filter = 0;
+    float filter_cutoff = 2000.0F;
+
+    bool limiter = false;
+};
+
+class DelayLine
+{
+    static constexpr size_t max_delay = 2 * 44100;
+    std::vector<float> buffer = std::vector<float>(max_delay);
+    size_t pos = 0;
+
+public:
+    void process(float* data, size_t n, size_t delay, float feedback,
+        float mix)
+    {
+        delay = std::clamp<size_t>(delay, 1, max_delay - 1);
+        for (size_t i = 0; i < n; i++) {
+            auto rp = (pos + max_delay - delay) % max_delay;
+            auto d = buffer[rp];
+            buffer[pos] = data[i] + d * feedback;
+            data[i] += d * mix;
+            pos = (pos + 1) % max_delay;
+        }
+    }
+};
+
+// Freeverb style reverb; parallel comb filters followed by allpass filters
+class Reverb
+{
+    struct Comb
+    {
+        std::vector<float> buffer;
+        size_t pos = 0;
+        float store = 0;
+        explicit Comb(size_t size) : buffer(size) {}
+        float process(float in, float feedback, float damp)
+        {
+            auto out = buffer[pos];
+            store = out * (1 - damp) + store * damp;
+            buffer[pos] = in + store * feedback;
+            pos = (pos + 1) % buffer.size();
+            return out;
+        }
+    };
+
+    struct Allpass
+    {
+        std::vector<float> buffer;
+        size_t pos = 0;
+        explicit Allpass(size_t size) : buffer(size) {}
+        float process(float in)
+        {
+            auto b = buffer[pos];
+            buffer[pos] = in + b * 0.5F;
+            pos = (pos + 1) % buffer.size();
+            return b - in;
+        }
+    };
+
+    std::vector<Comb> combs;
+    std::vector<Allpass> allpasses;
+
+public:
+    // `spread` offsets the delay lengths, so left and right differ
+    explicit Reverb(size_t spread = 0)
+    {
+        for (size_t len : {1116, 1188, 1277, 1356, 1422, 1491}) {
+            combs.emplace_back(len + spread);
+        }
+        for (size_t len : {556, 441, 341}) {
+            allpasses.emplace_back(len + spread);
+        }
+    }
+
+    void process(float* data, size_t n, float room, float mix)
+    {
+        auto feedback = 0.7F + std::clamp(room, 0.0F, 1.0F) * 0.28F;
+        constexpr float damp = 0.2F;
+        constexpr float input_gain = 0.015F;
+        for (size_t i = 0; i < n; i++) {
+            auto in = data[i] * input_gain;
+            float out = 0;
+            for (auto& c : combs) {
+                out += c.process(in, feedback, damp);
+            }
+            for (auto& a : allpasses) {
+                out = a.process(out);
+            }
+            data[i] += out * mix;
+        }
+    }
+};
+
+// Simple one pole filter
+class OnePole
+{
+    float z = 0;
+
+public:
+    void process(float* data, size_t n, bool high_pass, float cutoff)
+    {
+        auto a = 1.0F - std::exp(-2.0F * 3.14159265F *
+                                 std::clamp(cutoff, 10.0F, 20000.0F) /
+                                 44100.0F);
+        for (size_t i = 0; i < n; i++) {
+            z += a * (data[i] - z);
+            data[i] = high_pass ? data[i] - z : z;
+        }
+    }
+};
+
+// Keeps the output under `threshold`. The gain is worked out once per
+// block from the block peak; it drops at once so the block can not go
+// over, and recovers smoothly across the following blocks. Below the
+// threshold the signal is left exactly as it is.
+class Limiter
+{
+    float env = 0;
+    float gain = 1.0F;
+
+public:
+    void process(float* left, float* right, size_t n)
+    {
+        constexpr float threshold = 0.8F;
+        constexpr float release = 0.9995F;
+        if (n == 0) { return; }
+
+        float peak = 0;
+        for (size_t i = 0; i < n; i++) {
+            peak = std::max(
+                peak, std::max(std::abs(left[i]), std::abs(right[i])));
+        }
+        env = std::max(peak, env * std::pow(release, static_cast<float>(n)));
+        auto target = env > threshold ? threshold / env : 1.0F;
+
+        auto g = std::min(gain, target);
+        auto step = (target - g) / static_cast<float>(n);
+        for (size_t i = 0; i < n; i++) {
+            left[i] *= g;
+            right[i] *= g;
+            g += step;
+        }
+        gain = target;
+    }
+};
+
+class EffectBus
+{
+    BusParams params;
+    std::array<DelayLine, 2> delay;
+    std::array<Reverb, 2> reverb{Reverb{0}, Reverb{23}};
+    std::array<OnePole, 2> filter;
+    Limiter limiter;
+
+public:
+    void set(BusParams const& p) { params = p; }
+
+    void process(float* left, float* right, size_t n)
+    {
+        std::array<float*, 2> data{left, right};
+        for (size_t c = 0; c < 2; c++) {
+            auto* d = data[c];
+            if (params.filter != 0) {
+                filter[c].process(
+                    d, n, params.filter == 2, params.filter_cutoff);
+            }
+            if (params.delay_time > 0) {
+                delay[c].process(d, n,
+                    static_cast<size_t>(params.delay_time * 44100.0F),
+                    params.delay_feedback, params.delay_mix);
+            }
+            if (params.reverb_mix > 0) {
+                reverb[c].process(d, n, params.reverb_room, params.reverb_mix);
+            }
+            for (size_t i = 0; i < n; i++) {
+                d[i] *= params.volume;
+            }
+        }
+        if (params.limiter) { limiter.process(left, right, n); }
+    }
+};
@@ -0,0 +1,143 @@
+#include "audio_stream.hpp"
+
+#include <fmt/format.h>
+
+#include <algorithm>
+
+using namespace std::chrono_literals;
+
+void AudioStream::write_interleaved(float const* data, size_t frames)
+{
+    if (channels == 1) {
+        rings[0].write(data, frames);
+        return;
+    }
+    std::array<float, 1024> plane; // NOLINT
+    while (frames > 0) {
+        auto n = std::min(frames, plane.size());
+        for (unsigned c = 0; c < 2; c++) {
+            for (size_t i = 0; i < n; i++) {
+                plane[i] = data[i * channels + c];
+            }
+            rings[c].write(plane.data(), n);
+        }
+        data += n * channels;
+        frames -= n;
+    }
+}
+
+WavStream::WavStream(std::filesystem::path const& file_name)
+{
+    if (drwav_init_file(&wav, file_name.string().c_str(), nullptr) ==
+        DRWAV_FALSE) {
+        done = true;
+        return;
+    }
+    opened = true;
+    // We can only mix 2 channels, any extra will be ignored
+    channels = std::min(static_cast<unsigned>(wav.channels), 2U);
+    freq = static_cast<float>(wav.sampleRate);
+    temp.resize(4096 * wav.channels);
+}
+
+WavStream::~WavStream()
+{
+    if (opened) { drwav_uninit(&wav); }
+}
+
+void WavStream::fill()
+{
+    if (!opened || done) { return; }
+    auto frames = std::min(space(), temp.size() / wav.channels);
+    while (frames > 0) {
+        auto n = drwav_read_pcm_frames_f32(&wav, frames, temp.data());
+        if (n == 0) {
+            done = true;
+            return;
+        }
+        if (wav.channels > 2) {
+            // Drop extra channels
+            for (size_t i = 0; i < n; i++) {
+                temp[i * 2] = temp[i * wav.channels];
+                temp[i * 2 + 1] = temp[i * wav.channels + 1];
+            }
+        }
+        write_interleaved(temp.data(), n);
+        frames = std::min(space(), temp.size() / wav.channels);
+    }
+}
+
+void BufferedStream::push(float const* data, size_t frames)
+{
+    std::lock_guard lock{m};
+    queued.insert(queued.end(), data, data + frames);
+}
+
+void BufferedStream::finish()
+{
+    std::lock_guard lock{m};
+    finished_writing = true;
+}
+
+void BufferedStream::fill()
+{
+    std::lock_guard lock{m};
+    auto n = std::min(space(), queued.size() - read_pos);
+    rings[0].write(queued.data() + read_pos, n);
+    read_pos += n;
+    if (read_pos == queued.size()) {
+        queued.clear();
+        read_pos = 0;
+        if (finished_writing) { done = true; }
+    }
+}
+
+StreamDecoder::StreamDecoder()
+{
+#ifndef __EMSCRIPTEN__
+    decoder_thread = std::thread{&StreamDecoder::run, this};
+#endif
+}
+
+StreamDecoder::~StreamDecoder()
+{
+    quit = true;
+    cv.notify_all();
+    if (decoder_thread.joinable()) { decoder_thread.join(); }
+}
+
+void StreamDecoder::add(std::shared_ptr<AudioStream> const& stream)
+{
+    {
+        std::lock_guard lock{m};
+        streams.push_back(stream);
+    }
+    cv.notify_all();
+}
+
+void StreamDecoder::poll()
+{
+    std::vector<std::shared_ptr<AudioStream>> active;
+    {
+        std::lock_guard lock{m};
+        // Drop streams that are finished, or that no one else references
+        streams.erase(std::remove_if(streams.begin(), streams.end(),
+                          [](auto const& s) {
+                              return s->done || s.use_count() == 1;
+                          }),
+            streams.end());
+        active = streams;
+    }
+    for (auto const& s : active) {
+        s->fill();
+    }
+}
+
+void StreamDecoder::run()
+{
+    while (!quit) {
+        poll();
+        std::unique_lock lock{m};
+        cv.wait_for(lock, 10ms);
+    }
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "ring_buffer.hpp"
+
+#include <dr_libs/dr_wav.h>
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Audio that is produced a little at a time on a background thread and
+// consumed by the mixer. Each channel gets its own ring buffer, so memory
+// use is constant regardless of length.
+class AudioStream
+{
+public:
+    static constexpr size_t ring_size = 32768;
+
+    std::array<Ring<float, ring_size>, 2> rings;
+    unsigned channels = 1;
+    float freq = 44100;
+
+    // Set by the producer when no more data will be written
+    std::atomic<bool> done{false};
+
+    virtual ~AudioStream() = default;
+
+    // Called from the decoder thread. Top up the ring buffers.
+    virtual void fill() {}
+
+    // Space left in the ring buffers, in frames
+    size_t space() const
+    {
+        return ring_size - rings[channels - 1].available();
+    }
+
+    bool finished(int plane) const
+    {
+        return done && rings[plane].available() == 0;
+    }
+
+    // Write interleaved frames into the ring buffers
+    void write_interleaved(float const* data, size_t frames);
+};
+
+// Stream a WAV file from disk
+class WavStream : public AudioStream
+{
+    drwav wav{};
+    bool opened = false;
+    std::vector<float> temp;
+
+public:
+    explicit WavStream(std::filesystem::path const& file_name);
+    ~WavStream() override;
+    bool is_open() const { return opened; }
+    void fill() override;
+};
+
+// Mono stream fed by a producer that can not wait for ring buffer space,
+// like a speech synthesizer. Produced samples are queued and moved into the
+// ring buffer by `fill()`.
+class BufferedStream : public AudioStream
+{
+    std::mutex m;
+    std::vector<float> queued;
+    size_t read_pos = 0;
+    bool finished_writing = false;
+
+public:
+    explicit BufferedStream(float hz) { freq = hz; }
+
+    // Can be called from any thread
+    void push(float const* data, size_t frames);
+    void finish();
+
+    void fill() override;
+};
+
+// Background thread that keeps all active streams filled
+class StreamDecoder
+{
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<AudioStream>> streams;
+    std::atomic<bool> quit{false};
+    std::thread decoder_thread;
+
+    void run();
+
+public:
+    StreamDecoder();
+    ~StreamDecoder();
+
+    void add(std::shared_ptr<AudioStream> const& stream);
+
+    // Fill all streams once. Normally called by the decoder thread.
+    void poll();
+};
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+// Bytecode for the scripts in sys/, compiled by mrbc and linked into the
+// binary by the build. See `embedded_scripts.cpp.in`.
+struct EmbeddedScript
+{
+    char const* name;
+    uint8_t const* irep;
+};
+
+// Look up a script by file name, like "os.rb". Returns nullptr if it
+// is not embedded.
+uint8_t const* find_embedded_script(std::string_view name);
@@ -1,6 +1,7 @@
 #pragma once
 #include "mrb_tools.hpp"
 #include "mruby/array.h"
+#include <array>
 #include <deque>
 #include <mruby/boxing_word.h>
 #include <string>
@@ -25,31 +26,45 @@ public:
     static inline std::deque<Error> stack;
 };
 
+// Collect the pending exception into the error stack. Only called when
+// a handler raised, so the backtrace is never built otherwise.
+inline void handle_exception(mrb_state* ruby)
+{
+    auto bt = mrb_funcall(ruby, mrb_obj_value(ruby->exc), "backtrace", 0);
+
+    std::vector<std::string> backtrace;
+    for (int i = 0; i < ARY_LEN(mrb_ary_ptr(bt)); i++) {
+        auto v = mrb_ary_entry(bt, i);
+        auto s = mrb_funcall(ruby, v, "to_s", 0);
+        std::string line(RSTRING_PTR(s), RSTRING_LEN(s));
+        fmt::print("LINE:{}\n", line);
+        backtrace.emplace_back(line);
+    }
+
+    auto obj = mrb_funcall(ruby, mrb_obj_value(ruby->exc), "inspect", 0);
+    std::string err(RSTRING_PTR(obj), RSTRING_LEN(obj));
+
+    ErrorState::stack.push_back({ErrorType::Exception, backtrace, err});
+    fmt::print("Error: {}\n", err);
+    ruby->exc = nullptr;
+}
+
+// Call a ruby handler (normally a Proc) with the given arguments. Called
+// for every event, draw and timer tick, so the `call` symbol is looked up
+// once, and anything allocated by the handler is released from the GC
+// arena afterwards. This goes through mrb_funcall_argv() and not
+// mrb_yield_argv(), since only the former catches an exception raised
+// when called from outside the VM.
 template <typename... T>
 bool call_proc(mrb_state* ruby, mrb_value handler, T... arg)
 {
     if (handler.w == 0) { return false; }
-    mrb_funcall(
-        ruby, handler, "call", sizeof...(arg), mrb::to_value(arg, ruby)...);
-    if (ruby->exc != nullptr) {
-        auto bt = mrb_funcall(ruby, mrb_obj_value(ruby->exc), "backtrace", 0);
-    
-        std::vector<std::string> backtrace;
-        for(int i=0; i< ARY_LEN(mrb_ary_ptr(bt)); i++) {
-            auto v = mrb_ary_entry(bt, i);
-            auto s = mrb_funcall(ruby, v, "to_s", 0);
-            std::string line(RSTRING_PTR(s), RSTRING_LEN(s));
-            fmt::print("LINE:{}\n", line);
-            backtrace.emplace_back(line);
-        }
-
-        auto obj = mrb_funcall(ruby, mrb_obj_value(ruby->exc), "inspect", 0);
-        std::string err(RSTRING_PTR(obj), RSTRING_LEN(obj));
-
-        ErrorState::stack.push_back({ErrorType::Exception, backtrace, err});
-        fmt::print("Error: {}\n", err);
-        ruby->exc = nullptr;
-        return true;
-    }
-    return false;
+    auto ai = mrb_gc_arena_save(ruby);
+    std::array<mrb_value, sizeof...(arg)> argv{mrb::to_value(arg, ruby)...};
+    static mrb_sym const call_sym = mrb_intern_lit(ruby, "call");
+    mrb_funcall_argv(ruby, handler, call_sym, argv.size(), argv.data());
+    bool failed = ruby->exc != nullptr;
+    if (failed) { handle_exception(ruby); }
+    mrb_gc_arena_restore(ruby, ai);
+    return failed;
 }
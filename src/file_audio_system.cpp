@@ -0,0 +1,190 @@
+#include "system.hpp"
+
+#include <dr_libs/dr_wav.h>
+#include <fmt/format.h>
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Wraps another System, but instead of playing audio on a device the
+// audio callback is run from a thread of its own, and the output is
+// written to a WAV file.
+//
+// Audio time is locked to rendered frames; every `swap()` lets the
+// mixer produce exactly one frame worth of audio, and waits for it.
+// This makes the output independent of how fast frames are rendered,
+// so the same script always produces the same file.
+class FileAudioSystem : public System
+{
+    static constexpr int hz = 44100;
+    static constexpr uint64_t frame_samples = hz / 60;
+
+    class FileAudioScreen : public Screen
+    {
+        std::shared_ptr<Screen> screen;
+        FileAudioSystem* system;
+
+    public:
+        FileAudioScreen(std::shared_ptr<Screen> s, FileAudioSystem* sys)
+            : screen(std::move(s)), system(sys)
+        {}
+        void swap() override
+        {
+            if (screen) { screen->swap(); }
+            system->advance();
+        }
+        std::pair<int, int> get_size() override
+        {
+            return screen ? screen->get_size() : std::pair{-1, -1};
+        }
+    };
+
+    std::unique_ptr<System> system;
+    std::filesystem::path file_name;
+    uint64_t max_samples = 0;
+    size_t period = 1024;
+
+    drwav wav{};
+    bool opened = false;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::function<void(float*, size_t)> audio_callback;
+    uint64_t granted = 0;
+    uint64_t rendered = 0;
+    bool quit = false;
+    bool quit_sent = false;
+    std::thread render_thread;
+
+    std::chrono::steady_clock::duration mix_time{};
+
+    void advance()
+    {
+        if (!opened) { return; }
+        std::unique_lock lock{m};
+        granted += frame_samples;
+        if (max_samples > 0) { granted = std::min(granted, max_samples); }
+        cv.notify_all();
+        cv.wait(lock,
+            [&] { return rendered >= granted || !audio_callback || quit; });
+    }
+
+    void run()
+    {
+        std::vector<float> buffer(period * 2);
+        std::unique_lock lock{m};
+        while (true) {
+            cv.wait(lock, [&] {
+                return quit || (audio_callback && rendered < granted);
+            });
+            if (quit) { break; }
+            auto n = std::min<uint64_t>(period, granted - rendered);
+            lock.unlock();
+
+            auto start = std::chrono::steady_clock::now();
+            audio_callback(buffer.data(), n * 2);
+            mix_time += std::chrono::steady_clock::now() - start;
+            drwav_write_pcm_frames(&wav, n, buffer.data());
+
+            lock.lock();
+            rendered += n;
+            cv.notify_all();
+        }
+    }
+
+public:
+    FileAudioSystem(std::unique_ptr<System> sys, Settings const& settings)
+        : system(std::move(sys)),
+          file_name(settings.audio_out),
+          max_samples(static_cast<uint64_t>(settings.audio_length * hz)),
+          period(static_cast<size_t>(
+              settings.audio_buffer > 0 ? settings.audio_buffer : 4096))
+    {}
+
+    ~FileAudioSystem() override
+    {
+        {
+            std::lock_guard lock{m};
+            quit = true;
+        }
+        cv.notify_all();
+        if (render_thread.joinable()) { render_thread.join(); }
+        if (opened) {
+            drwav_uninit(&wav);
+            auto ms = std::chrono::duration_cast<std::chrono::microseconds>(
+                          mix_time)
+                          .count() /
+                      1000.0;
+            auto seconds = static_cast<double>(rendered) / hz;
+            fmt::print("Rendered {:.2f}s of audio to {} in {:.1f}ms of "
+                       "mixing ({:.0f}x realtime)\n",
+                seconds, file_name.string(), ms,
+                ms > 0 ? seconds * 1000.0 / ms : 0.0);
+        }
+    }
+
+    std::shared_ptr<Screen> init_screen(Settings const& settings) override
+    {
+        return std::make_shared<FileAudioScreen>(
+            system->init_screen(settings), this);
+    }
+
+    void init_audio(Settings const&) override
+    {
+        drwav_data_format format{};
+        format.container = drwav_container_riff;
+        format.format = DR_WAVE_FORMAT_IEEE_FLOAT;
+        format.channels = 2;
+        format.sampleRate = hz;
+        format.bitsPerSample = 32;
+        if (drwav_init_file_write(
+                &wav, file_name.string().c_str(), &format, nullptr) ==
+            DRWAV_FALSE) {
+            fmt::print("Could not open {} for writing\n", file_name.string());
+            return;
+        }
+        opened = true;
+        render_thread = std::thread{&FileAudioSystem::run, this};
+    }
+
+    void set_audio_callback(
+        std::function<void(float*, size_t)> const& cb) override
+    {
+        {
+            std::lock_guard lock{m};
+            audio_callback = cb;
+        }
+        cv.notify_all();
+    }
+
+    AnyEvent poll_events() override
+    {
+        if (max_samples > 0 && !quit_sent) {
+            std::lock_guard lock{m};
+            if (rendered >= max_samples) {
+                quit_sent = true;
+                return QuitEvent{};
+            }
+        }
+        return system->poll_events();
+    }
+
+    void init_input(Settings const& settings) override
+    {
+        system->init_input(settings);
+    }
+
+    void map_key(uint32_t code, uint32_t target, int mods) override
+    {
+        system->map_key(code, target, mods);
+    }
+};
+
+std::unique_ptr<System> create_file_audio_system(
+    std::unique_ptr<System> system, Settings const& settings)
+{
+    return std::make_unique<FileAudioSystem>(std::move(system), settings);
+}
@@ -0,0 +1,170 @@
+#include "frame_timer.hpp"
+
+#include "mrb_tools.hpp"
+
+#include <mruby/hash.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <string>
+
+void FrameTimer::begin_frame()
+{
+    auto& frame = ring[current];
+    frame.phases.clear();
+    frame.start = now();
+    frame.duration = 0;
+    depth = 0;
+}
+
+void FrameTimer::end_frame()
+{
+    auto& frame = ring[current];
+    frame.duration = now() - frame.start;
+    gl_wrap::GLStats::end_frame();
+    frame.gl = gl_wrap::GLStats::last;
+    current = (current + 1) % history;
+    completed = std::min(completed + 1, history);
+}
+
+size_t FrameTimer::begin(char const* name)
+{
+    auto& phases = ring[current].phases;
+    phases.push_back({name, now(), 0, depth++});
+    return phases.size() - 1;
+}
+
+void FrameTimer::end(size_t index)
+{
+    auto& phases = ring[current].phases;
+    depth--;
+    // The frame may have ended while the scope was open
+    if (index >= phases.size()) { return; }
+    phases[index].duration = now() - phases[index].start;
+}
+
+std::vector<FrameTimer::Frame const*> FrameTimer::frames() const
+{
+    std::vector<Frame const*> result;
+    for (size_t i = 0; i < completed; i++) {
+        result.push_back(&ring[(current + history - completed + i) % history]);
+    }
+    return result;
+}
+
+bool FrameTimer::write_trace(std::filesystem::path const& file_name) const
+{
+    std::ofstream out{file_name};
+    if (!out) { return false; }
+    out << "{\"traceEvents\":[\n";
+    bool first = true;
+    auto event = [&](char const* name, int64_t start, int64_t duration) {
+        out << (first ? "" : ",\n")
+            << fmt::format(R"({{"name":"{}","ph":"X","ts":{},"dur":{},)"
+                           R"("pid":1,"tid":1}})",
+                   name, start, duration);
+        first = false;
+    };
+    for (auto const* frame : frames()) {
+        event("frame", frame->start, frame->duration);
+        for (auto const& phase : frame->phases) {
+            event(phase.name, phase.start, phase.duration);
+        }
+        if (gl_wrap::GLStats::enabled()) {
+            // Counter track with the GL calls of each frame
+            out << fmt::format(
+                R"(,{{"name":"gl","ph":"C","ts":{},"pid":1,"args":{{)",
+                frame->start);
+            for (size_t i = 0; i < gl_wrap::GLStats::count; i++) {
+                out << fmt::format(R"({}"{}":{})", i == 0 ? "" : ",",
+                    gl_wrap::GLStats::names[i], frame->gl[i]);
+            }
+            out << "}}";
+        }
+    }
+    out << "\n],\"displayTimeUnit\":\"ms\"}\n";
+    return true;
+}
+
+void FrameTimer::reg_class(mrb_state* ruby)
+{
+    default_timer = new FrameTimer();
+
+    // Extended by os.rb
+    auto* os = mrb_define_module(ruby, "OS");
+
+    // Returns { phase => { last:, avg:, max: } } in milliseconds, over the
+    // recorded frames
+    mrb_define_module_function(
+        ruby, os, "frame_stats",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            struct Sum
+            {
+                int64_t last = 0;
+                int64_t total = 0;
+                int64_t max = 0;
+            };
+            std::map<std::string, Sum> sums;
+            auto frames = default_timer->frames();
+            auto add = [&](char const* name, int64_t us, bool latest) {
+                auto& s = sums[name];
+                s.total += us;
+                s.max = std::max(s.max, us);
+                if (latest) { s.last = us; }
+            };
+            for (size_t i = 0; i < frames.size(); i++) {
+                auto latest = i == frames.size() - 1;
+                add("frame", frames[i]->duration, latest);
+                for (auto const& phase : frames[i]->phases) {
+                    add(phase.name, phase.duration, latest);
+                }
+            }
+
+            auto ms = [&](int64_t us) {
+                return mrb::to_value(static_cast<double>(us) / 1000.0, mrb);
+            };
+            auto sym = [&](char const* name) {
+                return mrb_symbol_value(mrb_intern_cstr(mrb, name));
+            };
+            auto hash = mrb_hash_new(mrb);
+            auto count = static_cast<int64_t>(std::max<size_t>(frames.size(), 1));
+            for (auto const& [name, s] : sums) {
+                auto entry = mrb_hash_new(mrb);
+                mrb_hash_set(mrb, entry, sym("last"), ms(s.last));
+                mrb_hash_set(mrb, entry, sym("avg"), ms(s.total / count));
+                mrb_hash_set(mrb, entry, sym("max"), ms(s.max));
+                mrb_hash_set(mrb, hash, sym(name.c_str()), entry);
+            }
+            return hash;
+        },
+        MRB_ARGS_NONE());
+
+    // GL calls and uploaded bytes in the last frame, or nil if counting
+    // was compiled out
+    mrb_define_module_function(
+        ruby, os, "gl_stats",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            using gl_wrap::GLStats;
+            if (!GLStats::enabled()) { return mrb_nil_value(); }
+            auto hash = mrb_hash_new(mrb);
+            for (size_t i = 0; i < GLStats::count; i++) {
+                mrb_hash_set(mrb, hash,
+                    mrb_symbol_value(mrb_intern_cstr(mrb, GLStats::names[i])),
+                    mrb::to_value(static_cast<double>(GLStats::last[i]), mrb));
+            }
+            return hash;
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_module_function(
+        ruby, os, "write_trace",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            auto [file_name] = mrb::get_args<std::string>(mrb);
+            return mrb::to_value(
+                default_timer->write_trace(file_name), mrb);
+        },
+        MRB_ARGS_REQ(1));
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include "gl/stats.hpp"
+
+#include <mruby.h>
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Times the phases of each frame, and keeps the last `history` frames.
+// Phases can nest; a phase started while another is running becomes a
+// child of it.
+class FrameTimer
+{
+public:
+    using clk = std::chrono::steady_clock;
+    static constexpr size_t history = 120;
+
+    struct Phase
+    {
+        // Must be a string literal
+        char const* name;
+        // Microseconds since the timer was created
+        int64_t start;
+        int64_t duration;
+        int depth;
+    };
+
+    struct Frame
+    {
+        int64_t start = 0;
+        int64_t duration = 0;
+        std::vector<Phase> phases;
+        // GL calls made during the frame
+        gl_wrap::GLStats::Counts gl{};
+    };
+
+    // Ends the phase when it goes out of scope
+    class Scope
+    {
+        FrameTimer* timer;
+        size_t index;
+
+    public:
+        Scope(FrameTimer* t, size_t i) : timer{t}, index{i} {}
+        Scope(Scope const&) = delete;
+        Scope& operator=(Scope const&) = delete;
+        ~Scope() { timer->end(index); }
+    };
+
+    FrameTimer() : epoch{clk::now()} {}
+
+    void begin_frame();
+    void end_frame();
+
+    [[nodiscard]] Scope scope(char const* name) { return {this, begin(name)}; }
+
+    // Completed frames, oldest first
+    std::vector<Frame const*> frames() const;
+
+    // Write completed frames in Chrome's trace event format, for
+    // chrome://tracing or https://ui.perfetto.dev
+    bool write_trace(std::filesystem::path const& file_name) const;
+
+    static inline FrameTimer* default_timer = nullptr;
+    static void reg_class(mrb_state* ruby);
+
+private:
+    clk::time_point epoch;
+    std::array<Frame, history> ring;
+    size_t current = 0;
+    size_t completed = 0;
+    int depth = 0;
+
+    int64_t now() const
+    {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            clk::now() - epoch)
+            .count();
+    }
+
+    size_t begin(char const* name);
+    void end(size_t index);
+};
@@ -0,0 +1,112 @@
+#include "gc_pacer.hpp"
+
+#include "mrb_tools.hpp"
+
+#include <mruby/gc.h>
+#include <mruby/hash.h>
+
+#include <algorithm>
+
+// Same as in mruby's gc.c
+#ifndef MRB_HEAP_PAGE_SIZE
+#    define MRB_HEAP_PAGE_SIZE 1024
+#endif
+
+void GcPacer::begin_frame()
+{
+    auto& gc = ruby->gc;
+    if (budget_ms <= 0 || gc.disabled) { return; }
+    // If the frame allocates more than this, mruby collects as usual
+    auto headroom = std::max(gc.live, min_headroom);
+    gc.threshold = std::max(next_cycle, gc.live) + headroom;
+}
+
+void GcPacer::end_frame()
+{
+    auto& gc = ruby->gc;
+    stats.allocated = gc.live > live_at_end ? gc.live - live_at_end : 0;
+    stats.steps = 0;
+    stats.pause_ms = 0;
+
+    if (budget_ms > 0 && !gc.disabled) {
+        auto start = clk::now();
+        auto deadline =
+            start + std::chrono::duration_cast<clk::duration>(
+                        std::chrono::duration<double, std::milli>(budget_ms));
+        bool collect =
+            gc.state != MRB_GC_STATE_ROOT || gc.live >= next_cycle;
+        while (collect && clk::now() < deadline) {
+            mrb_incremental_gc(ruby);
+            stats.steps++;
+            if (gc.state == MRB_GC_STATE_ROOT) {
+                // mruby sets the threshold for the next cycle from what
+                // survived this one
+                next_cycle = gc.threshold;
+                stats.cycles++;
+                break;
+            }
+        }
+        stats.pause_ms =
+            std::chrono::duration<double, std::milli>(clk::now() - start)
+                .count();
+        stats.max_pause_ms = std::max(stats.max_pause_ms, stats.pause_ms);
+    }
+    live_at_end = gc.live;
+    stats.live = gc.live;
+}
+
+size_t GcPacer::heap_slots() const
+{
+    size_t pages = 0;
+    for (auto const* p = ruby->gc.heaps; p != nullptr; p = p->next) {
+        pages++;
+    }
+    return pages * MRB_HEAP_PAGE_SIZE;
+}
+
+void GcPacer::reg_class(mrb_state* ruby, double budget)
+{
+    default_pacer = new GcPacer(ruby, budget);
+
+    // Extend the GC module from mruby core
+    auto* gc_module = mrb_define_module(ruby, "GC");
+
+    mrb_define_module_function(
+        ruby, gc_module, "frame_stats",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            auto* pacer = default_pacer;
+            auto& stats = pacer->stats;
+            auto hash = mrb_hash_new(mrb);
+            auto set = [&](char const* name, auto value) {
+                mrb_hash_set(mrb, hash,
+                    mrb_symbol_value(mrb_intern_cstr(mrb, name)),
+                    mrb::to_value(value, mrb));
+            };
+            set("pause_ms", stats.pause_ms);
+            set("max_pause_ms", stats.max_pause_ms);
+            set("steps", stats.steps);
+            set("cycles", stats.cycles);
+            set("live", stats.live);
+            set("allocated", stats.allocated);
+            set("heap_slots", pacer->heap_slots());
+            stats.max_pause_ms = 0;
+            return hash;
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_module_function(
+        ruby, gc_module, "frame_budget=",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            auto [ms] = mrb::get_args<float>(mrb);
+            default_pacer->budget_ms = ms;
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_module_function(
+        ruby, gc_module, "frame_budget",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            return mrb::to_value(default_pacer->budget_ms, mrb);
+        },
+        MRB_ARGS_NONE());
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <mruby.h>
+
+#include <chrono>
+#include <cstddef>
+
+// Takes over garbage collection pacing from mruby. While a frame is
+// running the allocation threshold is raised, so a collection does not
+// start in the middle of a draw handler. Instead incremental GC steps are
+// run after the frame has been shown, until the time budget is used up.
+class GcPacer
+{
+    using clk = std::chrono::steady_clock;
+
+    mrb_state* ruby;
+    // Live objects where the next collection should start
+    size_t next_cycle = 0;
+    size_t live_at_end = 0;
+
+public:
+    struct Stats
+    {
+        // GC time spent after the last frame
+        double pause_ms = 0;
+        // Longest pause since stats were last read
+        double max_pause_ms = 0;
+        size_t steps = 0;
+        // Completed collections
+        size_t cycles = 0;
+        size_t live = 0;
+        // Objects allocated during the last frame, minus those freed
+        size_t allocated = 0;
+    };
+
+    // 0 means leave GC to mruby
+    double budget_ms;
+    // A frame can allocate at least this many objects without
+    // triggering a collection
+    size_t min_headroom = 10000;
+    Stats stats;
+
+    GcPacer(mrb_state* _ruby, double budget)
+        : ruby{_ruby}, next_cycle{_ruby->gc.threshold}, budget_ms{budget}
+    {}
+
+    void begin_frame();
+    void end_frame();
+
+    // Number of object slots in the heap
+    size_t heap_slots() const;
+
+    static inline GcPacer* default_pacer = nullptr;
+    static void reg_class(mrb_state* ruby, double budget);
+};
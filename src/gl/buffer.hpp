@@ -39,6 +39,7 @@ struct Buffer
     explicit Buffer(size_t size_in_bytes = 0)
     {
         glGenBuffers(1, &buffer);
+        count(Counter::BufferCreates);
         bind();
         if (size_in_bytes != 0) {
             glBufferData(to_glenum(Target), size_in_bytes, nullptr, Usage);
@@ -50,6 +51,7 @@ struct Buffer
     explicit Buffer(std::array<T, N> const& data)
     {
         glGenBuffers(1, &buffer);
+        count(Counter::BufferCreates);
         bind();
         set(data);
     }
@@ -58,6 +60,7 @@ struct Buffer
     explicit Buffer(std::vector<T> const& data)
     {
         glGenBuffers(1, &buffer);
+        count(Counter::BufferCreates);
         bind();
         set(data);
     }
@@ -66,11 +69,25 @@ struct Buffer
     void bind() const { glBindBuffer(to_glenum(Target), buffer); }
 
     // Bind this buffer and update part of its content
-    void update(void* data, size_t offset_in_bytes, size_t size_in_bytes)
+    void update(
+        void const* data, size_t offset_in_bytes, size_t size_in_bytes)
     {
         assert(size >= (offset_in_bytes + size_in_bytes));
         bind();
         glBufferSubData(to_glenum(Target), offset_in_bytes, size_in_bytes, data);
+        counted_upload(size_in_bytes);
+    }
+
+    // Bind this buffer and replace the start of its content. The old
+    // storage is orphaned first, so the driver does not have to wait for
+    // (or copy for) draws that are still reading it.
+    void stream(void const* data, size_t size_in_bytes)
+    {
+        assert(size >= size_in_bytes);
+        bind();
+        glBufferData(to_glenum(Target), size, nullptr, Usage);
+        glBufferSubData(to_glenum(Target), 0, size_in_bytes, data);
+        counted_upload(size_in_bytes);
     }
 
     // Bind this buffer and update part of its content
@@ -81,6 +98,7 @@ struct Buffer
         bind();
         glBufferSubData(to_glenum(Target), offset_in_bytes,
             data.size() * sizeof(T), data.data());
+        counted_upload(data.size() * sizeof(T));
     }
 
     // Bind this buffer and reset its content
@@ -90,6 +108,7 @@ struct Buffer
         bind();
         glBufferData(to_glenum(Target), size_in_bytes, data, Usage);
         size = size_in_bytes;
+        counted_upload(size);
     }
 
     // Bind this buffer and reset its content
@@ -99,6 +118,7 @@ struct Buffer
         glBufferData(
             to_glenum(Target), data.size() * sizeof(T), data.data(), Usage);
         size = data.size() * sizeof(T);
+        counted_upload(size);
     }
 
     // Bind this buffer and reset its content
@@ -108,6 +128,14 @@ struct Buffer
         glBufferData(
             to_glenum(Target), data.size() * sizeof(T), data.data(), Usage);
         size = data.size() * sizeof(T);
+        counted_upload(size);
+    }
+
+private:
+    static void counted_upload([[maybe_unused]] size_t bytes)
+    {
+        count(Counter::BufferUploads);
+        count(Counter::BufferBytes, bytes);
     }
 };
 
@@ -78,6 +78,8 @@ inline void clearColor(Color const& color)
 
 inline void setViewport(std::pair<GLint, GLint> wh)
 {
+    std::array<GLint, 4> data{0, 0, wh.first, wh.second};
+    if (detail::same(GLState::get().viewport, data)) { return; }
     glViewport(0, 0, wh.first, wh.second);
     gl_check("glViewport");
 }
@@ -85,9 +87,11 @@ inline void setViewport(std::pair<GLint, GLint> wh)
 template <typename T = GLint>
 inline std::pair<T, T> getViewport()
 {
-    std::array<GLint, 4> data; // NOLINT
-    glGetIntegerv(GL_VIEWPORT, data.data());
-    gl_check("glGetInteger");
+    auto& data = GLState::get().viewport;
+    if (data[2] < 0) {
+        glGetIntegerv(GL_VIEWPORT, data.data());
+        gl_check("glGetInteger");
+    }
     return {static_cast<T>(data[2]), static_cast<T>(data[3])};
 }
 
@@ -136,6 +140,7 @@ enum class Type
 inline void drawArrays(Primitive p, GLint offset, int count)
 {
     glDrawArrays(to_glenum(p), offset, count);
+    gl_wrap::count(Counter::DrawCalls);
     gl_check("glDrawArrays");
 }
 
@@ -148,6 +153,7 @@ inline void drawElements(Primitive p, int count, Type t, uintptr_t offset)
 {
     glDrawElements(
         to_glenum(p), count, to_glenum(t), to_ptr(offset));
+    gl_wrap::count(Counter::DrawCalls);
     gl_check("glDrawElements");
 }
 
@@ -4,9 +4,14 @@
 #ifdef USE_GLES
 #include <GLES/gl.h>
 #include <GLES2/gl2.h>
+#ifdef __EMSCRIPTEN__
+#include <GLES3/gl3.h>
+#endif
 #else
 #include <GL/glew.h>
 #endif
+#include "stats.hpp"
+
 #include <cstdint>
 #include <type_traits>
 
@@ -25,11 +30,16 @@ constexpr typename std::enable_if_t<std::is_arithmetic_v<T>, GLint> to_glint(T f
     return static_cast<GLint>(f);
 }
 
+// Defined in state.hpp
+inline void enableAttrib(GLint location, bool enable);
+
 struct Attribute
 {
     GLint location;
-    void enable() const { glEnableVertexAttribArray(location); }
-    void disable() const { glDisableVertexAttribArray(location); }
+    void enable() const { enableAttrib(location, true); }
+    void disable() const { enableAttrib(location, false); }
 };
 
 } // namespace gl_wrap
+
+#include "state.hpp"
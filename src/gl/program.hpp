@@ -5,6 +5,10 @@
 #include "shader.hpp"
 
 #include <cassert>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
 #include <vector>
 
 namespace gl_wrap {
@@ -13,33 +17,57 @@ struct Program
 {
     GLuint program = 0;
 
+    // Location and last set value of each uniform, so unchanged values
+    // are not sent again
+    struct Uniform
+    {
+        GLint location = -1;
+        std::vector<std::byte> value;
+    };
+    mutable std::unordered_map<std::string, Uniform> uniforms;
+
     Program() { program = glCreateProgram(); }
     Program(Program const&) = delete;
     Program(Program&& other) noexcept
     {
         program = other.program;
+        uniforms = std::move(other.uniforms);
         other.program = 0;
     }
     Program& operator=(Program const&) = delete;
     Program& operator=(Program&& other) noexcept
     {
         program = other.program;
+        uniforms = std::move(other.uniforms);
         other.program = 0;
         return *this;
     }
 
     explicit Program(GLuint _program) : program(_program) {}
 
+    // The program in use. Don't set uniforms through this; values are
+    // shadowed per Program object, so they would go stale in the owner.
     static inline Program& current()
     {
         static Program p;
-        glGetIntegerv(GL_CURRENT_PROGRAM, reinterpret_cast<GLint*>(&p.program));
+        auto& state = GLState::get();
+        if (state.program == GLState::unknown) {
+            glGetIntegerv(
+                GL_CURRENT_PROGRAM, reinterpret_cast<GLint*>(&state.program));
+        }
+        if (p.program != state.program) {
+            p.program = state.program;
+            p.uniforms.clear();
+        }
         return p;
     }
 
     ~Program()
     {
-        if (program != 0) { glDeleteProgram(program); }
+        if (program != 0) {
+            forgetProgram(program);
+            glDeleteProgram(program);
+        }
     }
 
     Program(VertexShader const& vs, FragmentShader const& fs)
@@ -57,7 +85,7 @@ struct Program
 
     void use() const
     {
-        glUseProgram(program);
+        useProgram(program);
         gl_check("glUseProgram");
     }
 
@@ -119,19 +147,56 @@ struct Program
         glUniform1i(location, v);
     }
 
+    template <typename T>
+    static void append_bytes(std::vector<std::byte>& out, T const& v)
+    {
+        if constexpr (std::is_same_v<T, std::vector<Color>>) {
+            for (auto const& c : v) {
+                append_bytes(out, c);
+            }
+        } else if constexpr (std::is_same_v<T, std::pair<float, float>>) {
+            append_bytes(out, v.first);
+            append_bytes(out, v.second);
+        } else {
+            static_assert(std::is_trivially_copyable_v<T>);
+            auto const* p = reinterpret_cast<std::byte const*>(&v);
+            out.insert(out.end(), p, p + sizeof(T));
+        }
+    }
+
+    Uniform& getUniform(const char* name) const
+    {
+        auto it = uniforms.find(name);
+        if (it != uniforms.end()) { return it->second; }
+        auto& u = uniforms[name];
+        u.location = glGetUniformLocation(program, name);
+        gl_check("glGetUniformLocation");
+        if (u.location == -1) {
+            fmt::print("WARN: '{}' does not exist\n", name);
+        }
+        return u;
+    }
+
     template <typename... ARGS>
     void setUniform(const char* name, ARGS... args) const
     {
-        auto location = glGetUniformLocation(program, name);
-        if (location == -1) {
-            fmt::print("WARN: '{}' does not exist\n", name);
+        auto& u = getUniform(name);
+        if (u.location == -1) { return; }
+
+        // GL is only used from one thread
+        static std::vector<std::byte> value;
+        value.clear();
+        (append_bytes(value, args), ...);
+        if (value == u.value) {
+            count(Counter::SkippedCalls);
             return;
         }
+        u.value.assign(value.begin(), value.end());
 
-        gl_check("glGetUniformLocation");
         use();
-        glUniform(location, args...);
+        glUniform(u.location, args...);
         gl_check("glUniform");
+        count(Counter::UniformSets);
     }
 };
 
@@ -3,6 +3,7 @@
 #include "functions.hpp"
 #include "gl.hpp"
 #include "program.hpp"
+#include "program_registry.hpp"
 
 #include <cassert>
 #include <string>
@@ -10,11 +11,9 @@
 
 namespace gl_wrap {
 
+// The two programs used for plain drawing. Owned by the ProgramRegistry.
 struct ProgramCache
 {
-    Program non_textured;
-    Program textured;
-
     std::string vertex_shader{R"gl( 
     #ifdef GL_ES
         precision mediump float;
@@ -56,31 +55,19 @@ struct ProgramCache
     static const inline std::string version = "";
 //#endif
 
-    Program get_program(std::string_view prefix) const
+    Program& get_program(std::string_view prefix) const
     {
-        using namespace std::string_literals;
-        Shader<ShaderType::Vertex> vs{
-            version + std::string(prefix) + vertex_shader};
-
-        Shader<ShaderType::Fragment> fs{
-            version + std::string(prefix) + fragment_shader};
-
-        // Get info log
-        auto info = getShaderInfoLog(vs.shader);
-        fmt::print("{}\n", info);
-
-        if (!fs || !vs) {
-            fprintf(stderr, "Could not compile shaders\n");
+        try {
+            return *ProgramRegistry::get().get_program(
+                vertex_shader, fragment_shader, version + std::string(prefix));
+        } catch (gl_exception const& e) {
+            fprintf(stderr, "Could not compile shaders: %s\n", e.what());
             exit(0);
         }
-        return Program(vs, fs);
     }
 
-    ProgramCache()
-    {
-        non_textured = get_program("");
-        textured = get_program("#define TEXTURED\n");
-    }
+    Program& non_textured = get_program("");
+    Program& textured = get_program("#define TEXTURED\n");
 
     static ProgramCache& get_instance()
     {
@@ -0,0 +1,222 @@
+#include "program_registry.hpp"
+
+#include "hash.hpp"
+
+#if defined(USE_GLES) && !defined(__EMSCRIPTEN__)
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+#endif
+
+#include <fmt/format.h>
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+namespace gl_wrap {
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// The binary entry points differ between GL and GLES2, where they only
+// exist as an extension that has to be looked up through EGL
+#if defined(__EMSCRIPTEN__)
+// WebGL has no program binaries
+#elif defined(USE_GLES)
+PFNGLGETPROGRAMBINARYOESPROC get_program_binary = nullptr;
+PFNGLPROGRAMBINARYOESPROC program_binary = nullptr;
+constexpr GLenum binary_length = GL_PROGRAM_BINARY_LENGTH_OES;
+constexpr GLenum binary_formats = GL_NUM_PROGRAM_BINARY_FORMATS_OES;
+#else
+constexpr GLenum binary_length = GL_PROGRAM_BINARY_LENGTH;
+constexpr GLenum binary_formats = GL_NUM_PROGRAM_BINARY_FORMATS;
+#endif
+
+bool get_binary([[maybe_unused]] GLuint program,
+    [[maybe_unused]] std::vector<char>& data, [[maybe_unused]] GLenum& format)
+{
+#if defined(__EMSCRIPTEN__)
+    return false;
+#else
+    auto size = getProgrami(program, binary_length);
+    if (size <= 0) { return false; }
+    data.resize(size);
+    GLsizei written = 0;
+#ifdef USE_GLES
+    get_program_binary(program, size, &written, &format, data.data());
+#else
+    glGetProgramBinary(program, size, &written, &format, data.data());
+#endif
+    data.resize(written);
+    return written > 0;
+#endif
+}
+
+bool put_binary([[maybe_unused]] GLuint program,
+    [[maybe_unused]] GLenum format, [[maybe_unused]] void const* data,
+    [[maybe_unused]] GLsizei size)
+{
+#if defined(__EMSCRIPTEN__)
+    return false;
+#else
+#ifdef USE_GLES
+    program_binary(program, format, data, size);
+#else
+    glProgramBinary(program, format, data, size);
+#endif
+    // An unknown format is an error, not just a failed link; don't let it
+    // show up in the next gl_check()
+    glGetError();
+    return getProgrami(program, GL_LINK_STATUS) == GL_TRUE;
+#endif
+}
+
+} // namespace
+
+ProgramRegistry& ProgramRegistry::get()
+{
+    static ProgramRegistry registry;
+    return registry;
+}
+
+bool ProgramRegistry::binaries_supported()
+{
+#if defined(__EMSCRIPTEN__)
+    return false;
+#else
+    static bool const supported = [] {
+#ifdef USE_GLES
+        auto const* ext =
+            reinterpret_cast<char const*>(glGetString(GL_EXTENSIONS));
+        if (ext == nullptr ||
+            std::strstr(ext, "GL_OES_get_program_binary") == nullptr) {
+            return false;
+        }
+        get_program_binary = reinterpret_cast<PFNGLGETPROGRAMBINARYOESPROC>(
+            eglGetProcAddress("glGetProgramBinaryOES"));
+        program_binary = reinterpret_cast<PFNGLPROGRAMBINARYOESPROC>(
+            eglGetProcAddress("glProgramBinaryOES"));
+        if (get_program_binary == nullptr || program_binary == nullptr) {
+            return false;
+        }
+#else
+        if (!(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary)) {
+            return false;
+        }
+#endif
+        // Some drivers have the extension but no formats to save in
+        GLint formats = 0;
+        glGetIntegerv(binary_formats, &formats);
+        return formats > 0;
+    }();
+    return supported;
+#endif
+}
+
+// Binaries only work with the driver that made them, so that is part of
+// the name
+fs::path ProgramRegistry::binary_file(uint64_t key) const
+{
+    if (cache_dir.empty() || !binaries_supported()) { return {}; }
+    static uint64_t const driver = [] {
+        auto hash = fnv1a(nullptr, 0);
+        for (GLenum what : {GL_VENDOR, GL_RENDERER, GL_VERSION}) {
+            auto const* s = reinterpret_cast<char const*>(glGetString(what));
+            if (s != nullptr) { hash = fnv1a(s, std::strlen(s) + 1, hash); }
+        }
+        return hash;
+    }();
+    auto hash = fnv1a(&driver, sizeof(driver), key);
+    return cache_dir / fmt::format("{:016x}.bin", hash);
+}
+
+bool ProgramRegistry::load_binary(Program& program, fs::path const& file)
+{
+    std::ifstream in{file, std::ios::binary};
+    if (!in) { return false; }
+    std::vector<char> data{std::istreambuf_iterator<char>(in), {}};
+    if (data.size() <= sizeof(GLenum)) { return false; }
+
+    GLenum format{};
+    memcpy(&format, data.data(), sizeof(GLenum));
+    if (!put_binary(program.program, format, data.data() + sizeof(GLenum),
+            static_cast<GLsizei>(data.size() - sizeof(GLenum)))) {
+        // Probably from an older driver; it will be saved again
+        std::error_code ec;
+        fs::remove(file, ec);
+        return false;
+    }
+    stats.loaded++;
+    return true;
+}
+
+void ProgramRegistry::save_binary(Program const& program, fs::path const& file)
+{
+    std::vector<char> data;
+    GLenum format{};
+    if (!get_binary(program.program, data, format)) { return; }
+
+    std::error_code ec;
+    fs::create_directories(cache_dir, ec);
+    // Write to a temporary file first, so a crash can't leave a partial
+    // binary behind
+    auto temp = fs::path(file).replace_extension(".tmp");
+    {
+        std::ofstream out{temp, std::ios::binary};
+        out.write(reinterpret_cast<char const*>(&format), sizeof(GLenum));
+        out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    }
+    fs::rename(temp, file, ec);
+}
+
+std::shared_ptr<Program> ProgramRegistry::get_program(
+    std::string_view vertex, std::string_view fragment, std::string_view defines)
+{
+    // Hash the terminating zeroes too, so text moving from one part to
+    // the next gives a different key
+    auto key = fnv1a(defines.data(), defines.size());
+    key = fnv1a("", 1, key);
+    key = fnv1a(vertex.data(), vertex.size(), key);
+    key = fnv1a("", 1, key);
+    key = fnv1a(fragment.data(), fragment.size(), key);
+
+    auto it = programs.find(key);
+    if (it != programs.end()) {
+        stats.shared++;
+        return it->second;
+    }
+
+    auto program = std::make_shared<Program>();
+    auto file = binary_file(key);
+    if (file.empty() || !load_binary(*program, file)) {
+        // Start over with a clean program object if a binary failed
+        if (!file.empty()) { program = std::make_shared<Program>(); }
+        std::string prefix{defines};
+        VertexShader vert{prefix + std::string(vertex)};
+        FragmentShader frag{prefix + std::string(fragment)};
+        if (!vert || !frag) {
+            throw gl_exception("Could not compile shaders");
+        }
+        vert.attach(program->program);
+        frag.attach(program->program);
+#if !defined(USE_GLES)
+        if (!file.empty()) {
+            glProgramParameteri(
+                program->program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+#endif
+        glLinkProgram(program->program);
+        gl_check("glLinkProgram");
+        if (getProgrami(program->program, GL_LINK_STATUS) != GL_TRUE) {
+            throw gl_exception("Linking failed");
+        }
+        stats.compiled++;
+        if (!file.empty()) { save_binary(*program, file); }
+    }
+    programs.emplace(key, program);
+    return program;
+}
+
+} // namespace gl_wrap
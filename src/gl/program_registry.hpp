@@ -0,0 +1,50 @@
+#pragma once
+#include "program.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+
+namespace gl_wrap {
+
+// All shader programs in the process, keyed by a hash of their source.
+// Asking for the same source twice returns the same program, so it is
+// only compiled once.
+//
+// If `cache_dir` is set and the driver can return program binaries
+// (GL_ARB_get_program_binary, or GL_OES_get_program_binary on GLES2), the
+// linked binaries are saved there and later runs load them instead of
+// compiling GLSL.
+class ProgramRegistry
+{
+    std::unordered_map<uint64_t, std::shared_ptr<Program>> programs;
+
+    std::filesystem::path binary_file(uint64_t key) const;
+    bool load_binary(Program& program, std::filesystem::path const& file);
+    void save_binary(Program const& program, std::filesystem::path const& file);
+
+public:
+    // Where program binaries are kept. Empty means no disk cache.
+    std::filesystem::path cache_dir;
+
+    struct Stats
+    {
+        int compiled = 0;
+        int loaded = 0;
+        int shared = 0;
+    };
+    Stats stats;
+
+    static ProgramRegistry& get();
+
+    static bool binaries_supported();
+
+    // `defines` is put in front of both shaders. Throws gl_exception if
+    // the program could not be built.
+    std::shared_ptr<Program> get_program(std::string_view vertex,
+        std::string_view fragment, std::string_view defines = "");
+};
+
+} // namespace gl_wrap
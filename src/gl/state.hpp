@@ -0,0 +1,184 @@
+#pragma once
+#include "gl.hpp"
+
+#include <array>
+#include <cstdint>
+#include <limits>
+
+namespace gl_wrap {
+
+// Shadow of the GL state that gl_wrap changes, so calls that would not
+// change anything can be skipped. Code that changes this state with raw
+// GL calls must call `invalidate()` afterwards.
+struct GLState
+{
+    static constexpr GLuint unknown = std::numeric_limits<GLuint>::max();
+    static constexpr int max_units = 8;
+
+    GLuint program = unknown;
+    GLuint active_unit = unknown;
+    std::array<GLuint, max_units> textures{};
+    GLuint framebuffer = unknown;
+    GLenum blend_src = unknown;
+    GLenum blend_dst = unknown;
+    // See blendAlphaCoverage()
+    bool alpha_coverage = false;
+    std::array<GLint, 4> viewport{-1, -1, -1, -1};
+    // Vertex attributes we know the state of, and which of those are
+    // enabled
+    uint32_t attribs_known = 0;
+    uint32_t attribs_enabled = 0;
+    // Bumped when a program is deleted, as anything keyed on program
+    // names may now be stale
+    uint32_t program_generation = 0;
+
+    GLState() { textures.fill(unknown); }
+
+    void invalidate()
+    {
+        auto generation = program_generation;
+        *this = GLState{};
+        program_generation = generation;
+    }
+
+    static GLState& get()
+    {
+        static GLState state;
+        return state;
+    }
+};
+
+namespace detail {
+// Returns true if `value` already holds `v`, else stores it
+template <typename T>
+inline bool same(T& value, T v)
+{
+    if (value == v) {
+        count(Counter::SkippedCalls);
+        return true;
+    }
+    value = v;
+    return false;
+}
+} // namespace detail
+
+inline void useProgram(GLuint program)
+{
+    if (detail::same(GLState::get().program, program)) { return; }
+    glUseProgram(program);
+    count(Counter::ProgramSwitches);
+}
+
+inline void activeTexture(int unit)
+{
+    auto u = static_cast<GLuint>(unit);
+    if (detail::same(GLState::get().active_unit, u)) { return; }
+    glActiveTexture(GL_TEXTURE0 + unit);
+}
+
+// Bind `tex` to the active texture unit
+inline void bindTexture(GLuint tex)
+{
+    auto& state = GLState::get();
+    if (state.active_unit >= GLState::max_units) {
+        glBindTexture(GL_TEXTURE_2D, tex);
+        return;
+    }
+    if (detail::same(state.textures[state.active_unit], tex)) { return; }
+    glBindTexture(GL_TEXTURE_2D, tex);
+}
+
+inline void bindTexture(int unit, GLuint tex)
+{
+    activeTexture(unit);
+    bindTexture(tex);
+}
+
+inline void bindFramebuffer(GLuint fb)
+{
+    if (detail::same(GLState::get().framebuffer, fb)) { return; }
+    glBindFramebuffer(GL_FRAMEBUFFER, fb);
+    count(Counter::FramebufferBinds);
+}
+
+inline void blendFunc(GLenum src, GLenum dst)
+{
+    auto& state = GLState::get();
+    if (state.blend_src == src && state.blend_dst == dst) {
+        count(Counter::SkippedCalls);
+        return;
+    }
+    state.blend_src = src;
+    state.blend_dst = dst;
+    if (state.alpha_coverage) {
+        glBlendFuncSeparate(src, dst, GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    } else {
+        glBlendFunc(src, dst);
+    }
+}
+
+// When drawing into a transparent target that is composited later, alpha
+// has to add up as coverage whatever the color blend is. The target then
+// holds premultiplied color and should be drawn with
+// (GL_ONE, GL_ONE_MINUS_SRC_ALPHA).
+inline void blendAlphaCoverage(bool on)
+{
+    auto& state = GLState::get();
+    if (detail::same(state.alpha_coverage, on)) { return; }
+    auto src = state.blend_src;
+    auto dst = state.blend_dst;
+    if (src == GLState::unknown) { return; }
+    state.blend_src = state.blend_dst = GLState::unknown;
+    blendFunc(src, dst);
+}
+
+inline void enableAttrib(GLint location, bool enable)
+{
+    auto& state = GLState::get();
+    if (location < 0) { return; }
+    if (location >= 32) {
+        if (enable) {
+            glEnableVertexAttribArray(location);
+        } else {
+            glDisableVertexAttribArray(location);
+        }
+        return;
+    }
+    auto bit = 1U << static_cast<uint32_t>(location);
+    if ((state.attribs_known & bit) != 0 &&
+        ((state.attribs_enabled & bit) != 0) == enable) {
+        count(Counter::SkippedCalls);
+        return;
+    }
+    state.attribs_known |= bit;
+    if (enable) {
+        state.attribs_enabled |= bit;
+        glEnableVertexAttribArray(location);
+    } else {
+        state.attribs_enabled &= ~bit;
+        glDisableVertexAttribArray(location);
+    }
+}
+
+// Deleting an object resets bindings to it, and the name may be reused
+inline void forgetTexture(GLuint tex)
+{
+    for (auto& t : GLState::get().textures) {
+        if (t == tex) { t = GLState::unknown; }
+    }
+}
+
+inline void forgetFramebuffer(GLuint fb)
+{
+    auto& state = GLState::get();
+    if (state.framebuffer == fb) { state.framebuffer = GLState::unknown; }
+}
+
+inline void forgetProgram(GLuint program)
+{
+    auto& state = GLState::get();
+    if (state.program == program) { state.program = GLState::unknown; }
+    state.program_generation++;
+}
+
+} // namespace gl_wrap
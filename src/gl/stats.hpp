@@ -0,0 +1,70 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Counts GL calls and uploaded bytes by category, so the cost of a frame
+// can be seen. Compiled out in release builds (when NDEBUG is set) unless
+// GL_STATS is defined.
+#if !defined(NDEBUG) || defined(GL_STATS)
+#    define GL_WRAP_STATS 1
+#endif
+
+namespace gl_wrap {
+
+enum class Counter
+{
+    DrawCalls,
+    BufferCreates,
+    BufferUploads,
+    BufferBytes,
+    TextureCreates,
+    TextureUploads,
+    TextureBytes,
+    ProgramSwitches,
+    UniformSets,
+    FramebufferBinds,
+    // Calls dropped because they would not change the GL state
+    SkippedCalls,
+    Count
+};
+
+struct GLStats
+{
+    static constexpr size_t count = static_cast<size_t>(Counter::Count);
+    using Counts = std::array<uint64_t, count>;
+
+    static constexpr std::array<char const*, count> names{"draw_calls",
+        "buffer_creates", "buffer_uploads", "buffer_bytes", "texture_creates",
+        "texture_uploads", "texture_bytes", "program_switches",
+        "uniform_sets", "framebuffer_binds", "skipped_calls"};
+
+    // Counts for the frame in progress, and the last completed frame
+    static inline Counts current{};
+    static inline Counts last{};
+
+    static constexpr bool enabled()
+    {
+#ifdef GL_WRAP_STATS
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    static void end_frame()
+    {
+        last = current;
+        current = {};
+    }
+};
+
+inline void count([[maybe_unused]] Counter c, [[maybe_unused]] uint64_t n = 1)
+{
+#ifdef GL_WRAP_STATS
+    GLStats::current[static_cast<size_t>(c)] += n;
+#endif
+}
+
+} // namespace gl_wrap
@@ -39,6 +39,7 @@ struct Texture
             source_format,
             // Underlying type in array
             type, data.data());
+        counted_upload(w, h, source_format, type);
     }
 
     template <typename T>
@@ -58,6 +59,7 @@ struct Texture
             source_format,
             // Underlying type in array
             type, data.data());
+        counted_upload(w, h, source_format, type);
     }
 
     template <typename T>
@@ -76,6 +78,7 @@ struct Texture
             source_format,
             // Underlying type in array
             type, data);
+        counted_upload(w, h, source_format, type);
     }
 
     Texture(GLint w, GLint h) : width(w), height(h)
@@ -84,7 +87,7 @@ struct Texture
         glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA,
             GL_UNSIGNED_BYTE, nullptr);
         glGenFramebuffers(1, &fb_id);
-        glBindFramebuffer(GL_FRAMEBUFFER, fb_id);
+        bindFramebuffer(fb_id);
         glFramebufferTexture2D(
             GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_id, 0);
     }
@@ -102,37 +105,49 @@ struct Texture
     Texture(Texture const&) = delete;
     Texture(Texture&& other) noexcept { move_from(std::move(other)); }
 
-    ~Texture()
+    void release() noexcept
     {
-        if (tex_id != 0) { glDeleteTextures(1, &tex_id); }
-        if (fb_id != 0) { glDeleteFramebuffers(1, &fb_id); }
-    };
+        if (tex_id != 0) {
+            forgetTexture(tex_id);
+            glDeleteTextures(1, &tex_id);
+            tex_id = 0;
+        }
+        if (fb_id != 0) {
+            forgetFramebuffer(fb_id);
+            glDeleteFramebuffers(1, &fb_id);
+            fb_id = 0;
+        }
+    }
+
+    ~Texture() { release(); }
 
     Texture& operator=(Texture const&) = delete;
 
     Texture& operator=(Texture&& other) noexcept
     {
-        move_from(std::move(other));
+        if (this != &other) {
+            release();
+            move_from(std::move(other));
+        }
         return *this;
     }
 
     void bind(int unit = 0) const
     {
-        glActiveTexture(GL_TEXTURE0 + unit);
-        glBindTexture(GL_TEXTURE_2D, tex_id);
+        bindTexture(unit, tex_id);
     }
 
     void set_target()
     {
         if (fb_id == 0) {
             // glActiveTexture(GL_TEXTURE0);
-            glBindTexture(GL_TEXTURE_2D, tex_id);
+            bindTexture(tex_id);
             glGenFramebuffers(1, &fb_id);
-            glBindFramebuffer(GL_FRAMEBUFFER, fb_id);
+            bindFramebuffer(fb_id);
             glFramebufferTexture2D(
                 GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_id, 0);
         } else {
-            glBindFramebuffer(GL_FRAMEBUFFER, fb_id);
+            bindFramebuffer(fb_id);
         }
         setViewport({width, height});
     }
@@ -147,7 +162,7 @@ struct Texture
         fmt::print("Read {},{} {}x{}\n", x, y, w, h);
         if (fb_id == 0) {
             glGenFramebuffers(1, &fb);
-            glBindFramebuffer(GL_FRAMEBUFFER, fb);
+            bindFramebuffer(fb);
             glFramebufferTexture2D(
                 GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_id, 0);
             gl_check("glFrameBufferTexture2d");
@@ -159,7 +174,7 @@ struct Texture
         auto type = GL_UNSIGNED_BYTE;
         glReadPixels(x, y, w, h, format, type, data.data());
         gl_check("glReadPixels");
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        bindFramebuffer(0);
         return data;
     }
 
@@ -172,9 +187,10 @@ struct Texture
                 0, GL_ALPHA, 0, GL_RGB, GL_RGBA};
             source_format = translate[sizeof(T)];
         }
-        glBindTexture(GL_TEXTURE_2D, tex_id);
+        bindTexture(tex_id);
         glTexSubImage2D(
             GL_TEXTURE_2D, 0, 0, 0, width, height, source_format, type, ptr);
+        counted_upload(width, height, source_format, type);
     }
 
     template <typename T>
@@ -186,11 +202,29 @@ struct Texture
                 0, GL_ALPHA, 0, GL_RGB, GL_RGBA};
             source_format = translate[sizeof(T)];
         }
-        glBindTexture(GL_TEXTURE_2D, tex_id);
+        bindTexture(tex_id);
         glTexSubImage2D(GL_TEXTURE_2D, 0, x, y, w, h, source_format, type, ptr);
+        counted_upload(w, h, source_format, type);
     }
 
     std::pair<float, float> size() const { return {width, height}; }
+
+private:
+    static void counted_upload([[maybe_unused]] GLint w,
+        [[maybe_unused]] GLint h, [[maybe_unused]] GLint source_format,
+        [[maybe_unused]] GLenum type)
+    {
+#ifdef GL_WRAP_STATS
+        uint64_t channels = source_format == GL_RGBA  ? 4
+                            : source_format == GL_RGB ? 3
+                                                      : 1;
+        uint64_t bytes = type == GL_FLOAT ? 4 : 1;
+        count(Counter::TextureUploads);
+        count(Counter::TextureBytes,
+            static_cast<uint64_t>(w) * static_cast<uint64_t>(h) * channels *
+                bytes);
+#endif
+    }
 };
 
 struct TexRef
@@ -0,0 +1,70 @@
+#pragma once
+#include "gl.hpp"
+
+#include <utility>
+
+namespace gl_wrap {
+
+// Wraps a vertex array object. These are core in GL 3 and GLES 3
+// (WebGL2); on GLES2 (Raspberry Pi) `supported()` is false and callers
+// have to set up their attributes for every draw instead.
+struct VertexArray
+{
+    GLuint vao = 0;
+
+    static bool supported()
+    {
+#if defined(__EMSCRIPTEN__)
+        return true;
+#elif defined(USE_GLES)
+        return false;
+#else
+        static bool const has_vao =
+            GLEW_VERSION_3_0 || GLEW_ARB_vertex_array_object;
+        return has_vao;
+#endif
+    }
+
+    VertexArray()
+    {
+#if !defined(USE_GLES) || defined(__EMSCRIPTEN__)
+        if (supported()) { glGenVertexArrays(1, &vao); }
+#endif
+    }
+
+    VertexArray(VertexArray const&) = delete;
+    VertexArray& operator=(VertexArray const&) = delete;
+    VertexArray(VertexArray&& other) noexcept : vao{other.vao}
+    {
+        other.vao = 0;
+    }
+    VertexArray& operator=(VertexArray&& other) noexcept
+    {
+        std::swap(vao, other.vao);
+        return *this;
+    }
+
+    ~VertexArray()
+    {
+#if !defined(USE_GLES) || defined(__EMSCRIPTEN__)
+        if (vao != 0) { glDeleteVertexArrays(1, &vao); }
+#endif
+    }
+
+    void bind() const
+    {
+#if !defined(USE_GLES) || defined(__EMSCRIPTEN__)
+        glBindVertexArray(vao);
+#endif
+    }
+
+    // Back to the default vertex array, which is what GLState tracks
+    static void unbind()
+    {
+#if !defined(USE_GLES) || defined(__EMSCRIPTEN__)
+        glBindVertexArray(0);
+#endif
+    }
+};
+
+} // namespace gl_wrap
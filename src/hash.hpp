@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// 64 bit FNV-1a. Pass the previous result as `hash` to hash several
+// pieces of data as one.
+inline uint64_t fnv1a(
+    void const* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL)
+{
+    auto const* p = static_cast<uint8_t const*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= p[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
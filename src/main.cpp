@@ -14,6 +14,7 @@ int main(int argc, char const** argv)
     bool full_screen = false;
     std::string font_name;
     std::string boot_cmd;
+    bool low_latency = false;
     Settings settings;
 
 #ifdef RASPBERRY_PI
@@ -32,6 +33,25 @@ int main(int argc, char const** argv)
     app.add_option("--main", settings.boot_script, "Main script");
     app.add_option("--font", font_name, "Console font (ttf_file[:size])");
     app.add_option("--console-benchmark", settings.console_benchmark, "Check speed of console");
+    app.add_flag("--dispatch-benchmark", settings.dispatch_benchmark,
+        "Check speed of calling ruby handlers");
+    app.add_flag("--low-latency", low_latency, "Small audio buffers");
+    app.add_option("--audio-buffer", settings.audio_buffer,
+        "Audio period size in frames");
+    app.add_option("--audio-periods", settings.audio_periods,
+        "Number of audio periods to buffer");
+    app.add_option("--audio-out", settings.audio_out,
+        "Render audio to WAV file instead of playing it");
+    app.add_option("--audio-length", settings.audio_length,
+        "Quit after this many seconds of audio");
+    app.add_option("--gc-budget", settings.gc_budget,
+        "Milliseconds per frame for garbage collection (0 = automatic)");
+    app.add_option("--profile", settings.profile_file,
+        "Profile ruby code and write collapsed stacks to file");
+    app.add_option("--cache-dir", settings.cache_dir,
+        "Where to store generated data like speech");
+    app.add_option("--sys-dir", settings.sys_dir,
+        "Load system scripts from this directory instead of the binary");
     CLI11_PARSE(app, argc, argv);
 
     if (!font_name.empty()) {
@@ -42,6 +62,12 @@ int main(int argc, char const** argv)
             settings.font_size = std::stoi(size);
         }
     }
+    if (low_latency && settings.audio_buffer == Settings{}.audio_buffer) {
+        settings.audio_buffer = 256;
+    }
+    // Audio time follows frames when writing to file, so run as fast as
+    // we can
+    if (!settings.audio_out.empty()) { settings.vsync = false; }
     settings.screen = full_screen ? ScreenType::Full : ScreenType::Window;
     Toy toy(settings);
     toy.run();
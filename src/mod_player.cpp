@@ -0,0 +1,440 @@
+#include "mod_player.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <fstream>
+#include <iterator>
+
+namespace {
+
+constexpr int min_period = 113;
+constexpr int max_period = 856;
+// Amiga PAL clock; a period of P gives clock / (P * 2) Hz
+constexpr float pal_clock = 7093789.2F;
+
+constexpr std::array<int, 32> sine_table{0, 24, 49, 74, 97, 120, 141, 161,
+    180, 197, 212, 224, 235, 244, 250, 253, 255, 253, 250, 244, 235, 224, 212,
+    197, 180, 161, 141, 120, 97, 74, 49, 24};
+
+int finetuned(int period, int finetune)
+{
+    if (finetune == 0) { return period; }
+    return static_cast<int>(
+        std::lround(period * std::pow(2.0, -finetune / 96.0)));
+}
+
+int channels_from_signature(std::string const& sig)
+{
+    if (sig == "M.K." || sig == "M!K!" || sig == "FLT4") { return 4; }
+    if (sig == "FLT8" || sig == "OCTA") { return 8; }
+    // "xCHN", like 6CHN
+    if (sig.substr(1) == "CHN" && std::isdigit(sig[0]) != 0 && sig[0] != '0') {
+        return sig[0] - '0';
+    }
+    // "xxCH", like 16CH
+    if (sig[2] == 'C' && sig[3] == 'H' && std::isdigit(sig[0]) != 0 &&
+        std::isdigit(sig[1]) != 0) {
+        return (sig[0] - '0') * 10 + (sig[1] - '0');
+    }
+    return 0;
+}
+
+} // namespace
+
+ModData::Note ModData::note(int pattern, int row, int chan) const
+{
+    auto const* p =
+        patterns.data() +
+        ((static_cast<size_t>(pattern) * 64 + row) * channels + chan) * 4;
+    return {(p[0] & 0xf0) | (p[2] >> 4), ((p[0] & 0x0f) << 8) | p[1],
+        p[2] & 0x0f, p[3]};
+}
+
+std::shared_ptr<ModData const> ModData::load(
+    std::filesystem::path const& file_name)
+{
+    std::ifstream in{file_name, std::ios::binary};
+    if (!in) { return nullptr; }
+    std::vector<uint8_t> buf{std::istreambuf_iterator<char>(in), {}};
+    if (buf.size() < 1084) { return nullptr; }
+
+    auto mod = std::make_shared<ModData>();
+    mod->channels = channels_from_signature(
+        std::string(reinterpret_cast<char const*>(&buf[1080]), 4));
+    if (mod->channels < 1 || mod->channels > 32) { return nullptr; }
+
+    auto be16 = [&](size_t offset) {
+        return static_cast<size_t>((buf[offset] << 8) | buf[offset + 1]);
+    };
+
+    auto const* title = reinterpret_cast<char const*>(buf.data());
+    mod->title.assign(title, std::find(title, title + 20, '\0'));
+
+    std::array<size_t, 31> lengths{};
+    for (size_t i = 0; i < 31; i++) {
+        auto offset = 20 + i * 30;
+        auto& s = mod->samples[i];
+        lengths[i] = be16(offset + 22) * 2;
+        auto ft = buf[offset + 24] & 0x0f;
+        s.finetune = ft > 7 ? ft - 16 : ft;
+        s.volume = std::min<int>(buf[offset + 25], 64);
+        s.loop_start = be16(offset + 26) * 2;
+        s.loop_length = be16(offset + 28) * 2;
+    }
+
+    auto song_length = std::clamp<size_t>(buf[950], 1, 128);
+    mod->restart = buf[951] < song_length ? buf[951] : 0;
+    mod->order.assign(&buf[952], &buf[952] + song_length);
+    // Patterns that are stored but not played still take up space
+    auto pattern_count = *std::max_element(&buf[952], &buf[952] + 128) + 1;
+
+    auto pattern_size = 64 * 4 * static_cast<size_t>(mod->channels);
+    size_t pos = 1084;
+    if (buf.size() < pos + pattern_count * pattern_size) { return nullptr; }
+    mod->patterns.assign(&buf[pos], &buf[pos] + pattern_count * pattern_size);
+    pos += pattern_count * pattern_size;
+
+    for (size_t i = 0; i < 31; i++) {
+        auto& s = mod->samples[i];
+        // Some files are truncated; keep what is there
+        auto len = std::min(lengths[i], buf.size() - pos);
+        s.data.resize(len);
+        std::transform(&buf[pos], &buf[pos] + len, s.data.begin(),
+            [](uint8_t b) { return static_cast<int8_t>(b); });
+        pos += len;
+        if (s.loop_start >= len) {
+            s.loop_start = 0;
+            s.loop_length = 0;
+        }
+        s.loop_length = std::min(s.loop_length, len - s.loop_start);
+    }
+    return mod;
+}
+
+ModPlayer::ModPlayer(std::shared_ptr<ModData const> data, bool _loop)
+    : mod(std::move(data)), loop(_loop)
+{
+    // Amiga channels are hard panned left, right, right, left. Keep some
+    // of each side in the other so it works in headphones.
+    for (size_t i = 0; i < channels.size(); i++) {
+        auto left = (i % 4 == 0 || i % 4 == 3);
+        channels[i].pan = left ? 0.25F : 0.75F;
+    }
+}
+
+void ModPlayer::render(float* left, float* right, size_t n)
+{
+    while (n > 0 && !finished) {
+        if (samples_left == 0) {
+            update_tick();
+            samples_left = static_cast<size_t>(rate * 2.5F / bpm);
+        }
+        auto count = std::min(n, samples_left);
+        for (int c = 0; c < mod->channels; c++) {
+            render_channel(channels[c], left, right, count);
+        }
+        left += count;
+        right += count;
+        n -= count;
+        samples_left -= count;
+    }
+}
+
+void ModPlayer::render_channel(
+    Channel& chan, float* left, float* right, size_t n)
+{
+    auto const* s = chan.sample;
+    if (s == nullptr || s->data.empty() || chan.step == 0) { return; }
+
+    auto gain = std::min(0.5F, 2.0F / static_cast<float>(mod->channels));
+    auto vol = static_cast<float>(chan.out_volume) / 64.0F * gain / 128.0F;
+    auto lg = vol * (1.0F - chan.pan);
+    auto rg = vol * chan.pan;
+
+    auto const* d = s->data.data();
+    bool looped = s->looped();
+    auto end = static_cast<float>(
+        looped ? s->loop_start + s->loop_length : s->data.size());
+    auto loop_len = static_cast<float>(s->loop_length);
+    auto last = s->data.size() - 1;
+
+    for (size_t i = 0; i < n; i++) {
+        if (chan.pos >= end) {
+            if (!looped) { return; }
+            while (chan.pos >= end) {
+                chan.pos -= loop_len;
+            }
+        }
+        auto idx = static_cast<size_t>(chan.pos);
+        auto frac = chan.pos - static_cast<float>(idx);
+        auto next = idx + 1;
+        if (static_cast<float>(next) >= end) {
+            next = looped ? s->loop_start : idx;
+        }
+        auto a = static_cast<float>(d[std::min(idx, last)]);
+        auto b = static_cast<float>(d[std::min(next, last)]);
+        auto v = a + (b - a) * frac;
+        left[i] += v * lg;
+        right[i] += v * rg;
+        chan.pos += chan.step;
+    }
+}
+
+void ModPlayer::update_tick()
+{
+    if (tick == 0 && !delaying) {
+        start_row();
+    } else {
+        for (int c = 0; c < mod->channels; c++) {
+            auto& chan = channels[c];
+            chan.out_period = chan.period;
+            chan.out_volume = chan.volume;
+            tick_effect(chan);
+        }
+    }
+    for (int c = 0; c < mod->channels; c++) {
+        update_step(channels[c]);
+    }
+
+    if (++tick >= speed) {
+        tick = 0;
+        if (pattern_delay > 0) {
+            pattern_delay--;
+            delaying = true;
+        } else {
+            delaying = false;
+            advance_row();
+        }
+    }
+}
+
+void ModPlayer::start_row()
+{
+    auto pattern = mod->order[order_pos];
+    for (int c = 0; c < mod->channels; c++) {
+        auto& chan = channels[c];
+        auto note = mod->note(pattern, row, c);
+        chan.effect = note.effect;
+        chan.param = note.param;
+        if (note.effect == 0xe && (note.param >> 4) == 0xd &&
+            (note.param & 0xf) != 0) {
+            chan.delayed = note;
+        } else {
+            trigger(chan, note);
+        }
+        row_effect(chan);
+        chan.out_period = chan.period;
+        chan.out_volume = chan.volume;
+    }
+}
+
+void ModPlayer::trigger(Channel& chan, ModData::Note const& note)
+{
+    if (note.sample > 0 && note.sample <= 31) {
+        auto const& s = mod->samples[note.sample - 1];
+        chan.sample = &s;
+        chan.volume = s.volume;
+        chan.finetune = s.finetune;
+    }
+    if (note.period == 0) { return; }
+    auto period = finetuned(note.period, chan.finetune);
+    if (note.effect == 0x3 || note.effect == 0x5) {
+        // Slide to the note instead of playing it
+        chan.target_period = period;
+        return;
+    }
+    chan.period = period;
+    chan.pos = 0;
+    chan.vibrato_pos = 0;
+    chan.tremolo_pos = 0;
+    if (note.effect == 0x9) {
+        if (note.param != 0) { chan.offset = note.param * 256; }
+        chan.pos = static_cast<float>(chan.offset);
+    }
+}
+
+// Effects applied once, on the first tick of a row
+void ModPlayer::row_effect(Channel& chan)
+{
+    auto x = chan.param >> 4;
+    auto y = chan.param & 0xf;
+    switch (chan.effect) {
+    case 0x3:
+        if (chan.param != 0) { chan.porta_speed = chan.param; }
+        break;
+    case 0x4:
+        if (x != 0) { chan.vibrato_speed = x; }
+        if (y != 0) { chan.vibrato_depth = y; }
+        break;
+    case 0x7:
+        if (x != 0) { chan.tremolo_speed = x; }
+        if (y != 0) { chan.tremolo_depth = y; }
+        break;
+    case 0x8: chan.pan = static_cast<float>(chan.param) / 255.0F; break;
+    case 0xb:
+        next_order = chan.param;
+        if (next_row < 0) { next_row = 0; }
+        break;
+    case 0xc: chan.volume = std::min(chan.param, 64); break;
+    case 0xd:
+        next_row = std::min(x * 10 + y, 63);
+        if (next_order < 0) { next_order = order_pos + 1; }
+        break;
+    case 0xe:
+        switch (x) {
+        case 0x1: chan.period = std::max(chan.period - y, min_period); break;
+        case 0x2: chan.period = std::min(chan.period + y, max_period); break;
+        case 0x6:
+            if (y == 0) {
+                chan.loop_row = row;
+            } else if (chan.loop_count == 0 || --chan.loop_count > 0) {
+                if (chan.loop_count == 0) { chan.loop_count = y; }
+                next_order = order_pos;
+                next_row = chan.loop_row;
+            }
+            break;
+        case 0xa: chan.volume = std::min(chan.volume + y, 64); break;
+        case 0xb: chan.volume = std::max(chan.volume - y, 0); break;
+        case 0xc:
+            if (y == 0) { chan.volume = 0; }
+            break;
+        case 0xe:
+            if (!delaying) { pattern_delay = y; }
+            break;
+        default: break;
+        }
+        break;
+    case 0xf:
+        if (chan.param == 0) { break; }
+        if (chan.param < 0x20) {
+            speed = chan.param;
+        } else {
+            bpm = chan.param;
+        }
+        break;
+    default: break;
+    }
+}
+
+// Effects applied on every tick except the first
+void ModPlayer::tick_effect(Channel& chan)
+{
+    auto x = chan.param >> 4;
+    auto y = chan.param & 0xf;
+    switch (chan.effect) {
+    case 0x0:
+        if (chan.param != 0) {
+            auto semis = tick % 3 == 1 ? x : tick % 3 == 2 ? y : 0;
+            chan.out_period = static_cast<int>(
+                static_cast<float>(chan.period) *
+                std::pow(2.0F, -static_cast<float>(semis) / 12.0F));
+        }
+        break;
+    case 0x1:
+        chan.period = std::max(chan.period - chan.param, min_period);
+        chan.out_period = chan.period;
+        break;
+    case 0x2:
+        chan.period = std::min(chan.period + chan.param, max_period);
+        chan.out_period = chan.period;
+        break;
+    case 0x3: tone_portamento(chan); break;
+    case 0x4: vibrato(chan); break;
+    case 0x5:
+        tone_portamento(chan);
+        volume_slide(chan);
+        break;
+    case 0x6:
+        vibrato(chan);
+        volume_slide(chan);
+        break;
+    case 0x7: {
+        auto delta =
+            sine_table[chan.tremolo_pos & 31] * chan.tremolo_depth / 64;
+        if ((chan.tremolo_pos & 32) != 0) { delta = -delta; }
+        chan.out_volume = std::clamp(chan.volume + delta, 0, 64);
+        chan.tremolo_pos = (chan.tremolo_pos + chan.tremolo_speed) & 63;
+        break;
+    }
+    case 0xa: volume_slide(chan); break;
+    case 0xe:
+        switch (x) {
+        case 0x9:
+            if (y != 0 && tick % y == 0) { chan.pos = 0; }
+            break;
+        case 0xc:
+            if (tick == y) {
+                chan.volume = 0;
+                chan.out_volume = 0;
+            }
+            break;
+        case 0xd:
+            if (tick == y) {
+                trigger(chan, chan.delayed);
+                chan.out_period = chan.period;
+                chan.out_volume = chan.volume;
+            }
+            break;
+        default: break;
+        }
+        break;
+    default: break;
+    }
+}
+
+void ModPlayer::volume_slide(Channel& chan)
+{
+    auto x = chan.param >> 4;
+    auto y = chan.param & 0xf;
+    chan.volume = std::clamp(chan.volume + (x != 0 ? x : -y), 0, 64);
+    chan.out_volume = chan.volume;
+}
+
+void ModPlayer::tone_portamento(Channel& chan)
+{
+    if (chan.target_period == 0) { return; }
+    if (chan.period < chan.target_period) {
+        chan.period =
+            std::min(chan.period + chan.porta_speed, chan.target_period);
+    } else {
+        chan.period =
+            std::max(chan.period - chan.porta_speed, chan.target_period);
+    }
+    chan.out_period = chan.period;
+}
+
+void ModPlayer::vibrato(Channel& chan)
+{
+    auto delta = sine_table[chan.vibrato_pos & 31] * chan.vibrato_depth / 128;
+    if ((chan.vibrato_pos & 32) != 0) { delta = -delta; }
+    chan.out_period = chan.period + delta;
+    chan.vibrato_pos = (chan.vibrato_pos + chan.vibrato_speed) & 63;
+}
+
+void ModPlayer::update_step(Channel& chan)
+{
+    chan.step = chan.out_period > 0
+                    ? pal_clock / (static_cast<float>(chan.out_period) * 2) /
+                          rate
+                    : 0.0F;
+}
+
+void ModPlayer::advance_row()
+{
+    if (next_order >= 0 || next_row >= 0) {
+        if (next_order >= 0) { order_pos = next_order; }
+        row = std::max(next_row, 0);
+        next_order = next_row = -1;
+    } else if (++row >= 64) {
+        row = 0;
+        order_pos++;
+    }
+    if (order_pos >= static_cast<int>(mod->order.size())) {
+        if (loop) {
+            order_pos = mod->restart;
+        } else {
+            finished = true;
+        }
+    }
+}
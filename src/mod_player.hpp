@@ -0,0 +1,126 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+// A Protracker style MOD file. Immutable once loaded, so it can be shared
+// by any number of players.
+struct ModData
+{
+    struct Sample
+    {
+        std::vector<int8_t> data;
+        int finetune = 0;
+        int volume = 64;
+        size_t loop_start = 0;
+        size_t loop_length = 0;
+        bool looped() const { return loop_length > 2; }
+    };
+
+    struct Note
+    {
+        int sample;
+        int period;
+        int effect;
+        int param;
+    };
+
+    std::string title;
+    int channels = 4;
+    std::array<Sample, 31> samples;
+    std::vector<uint8_t> order;
+    int restart = 0;
+    // 64 rows of `channels` 4 byte notes per pattern
+    std::vector<uint8_t> patterns;
+
+    Note note(int pattern, int row, int chan) const;
+
+    // Returns nullptr if the file could not be read or is not a MOD
+    static std::shared_ptr<ModData const> load(
+        std::filesystem::path const& file_name);
+};
+
+// Plays a ModData. Runs in the audio thread; `render()` never allocates.
+class ModPlayer
+{
+    static constexpr float rate = 44100.0F;
+
+    struct Channel
+    {
+        ModData::Sample const* sample = nullptr;
+        float pos = 0;
+        float step = 0;
+        float pan = 0.5F;
+
+        int period = 0;
+        int volume = 0;
+        int finetune = 0;
+
+        // Effect for the current row
+        int effect = 0;
+        int param = 0;
+
+        // Effect memory
+        int porta_speed = 0;
+        int target_period = 0;
+        int vibrato_speed = 0;
+        int vibrato_depth = 0;
+        int vibrato_pos = 0;
+        int tremolo_speed = 0;
+        int tremolo_depth = 0;
+        int tremolo_pos = 0;
+        int offset = 0;
+        int loop_row = 0;
+        int loop_count = 0;
+
+        // Period and volume after per tick modulation
+        int out_period = 0;
+        int out_volume = 0;
+
+        // Note waiting for a delay (EDx)
+        ModData::Note delayed{};
+    };
+
+    std::shared_ptr<ModData const> mod;
+    std::array<Channel, 32> channels;
+    bool loop;
+    std::atomic<bool> finished{false};
+
+    int speed = 6;
+    int bpm = 125;
+    int tick = 0;
+    int row = 0;
+    int order_pos = 0;
+    int pattern_delay = 0;
+    bool delaying = false;
+    size_t samples_left = 0;
+
+    // Set by jump/break effects, applied at the end of the row
+    int next_order = -1;
+    int next_row = -1;
+
+    void start_row();
+    void update_tick();
+    void advance_row();
+    void trigger(Channel& chan, ModData::Note const& note);
+    void row_effect(Channel& chan);
+    void tick_effect(Channel& chan);
+    void volume_slide(Channel& chan);
+    void tone_portamento(Channel& chan);
+    void vibrato(Channel& chan);
+    void update_step(Channel& chan);
+    void render_channel(Channel& chan, float* left, float* right, size_t n);
+
+public:
+    explicit ModPlayer(std::shared_ptr<ModData const> data, bool loop = true);
+
+    // Add the next `n` samples to the output
+    void render(float* left, float* right, size_t n);
+
+    bool done() const { return finished; }
+};
@@ -284,12 +284,15 @@ public:
         return NoEvent{};
     }
 
-    void init_audio(Settings const&) override
+    void init_audio(Settings const& settings) override
     {
         return;
-        player = std::make_unique<LinuxPlayer>(44100);
+        player = std::make_unique<LinuxPlayer>(
+            44100, settings.audio_buffer, settings.audio_periods);
     }
 
+    int audio_underruns() override { return player ? player->underruns : 0; }
+
     void set_audio_callback(
         std::function<void(float*, size_t)> const& fcb) override
     {
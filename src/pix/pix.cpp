@@ -1,10 +1,12 @@
 #include "pix.hpp"
 
 #include <array>
+#include <unordered_map>
 #include <gl/buffer.hpp>
 #include <gl/functions.hpp>
 #include <gl/program_cache.hpp>
 #include <gl/vec.hpp>
+#include <gl/vertex_array.hpp>
 #include <lodepng.h>
 
 namespace pix {
@@ -26,64 +28,138 @@ void set_colors(gl::Color fg, gl::Color bg)
     plain.setUniform("in_color", fg);
 }
 
-void draw_with_uvs()
-{
-    // gl::ProgramCache::get_instance().textured.use();
-    auto& program = gl::Program::current();
-    // auto& program = gl::ProgramCache::get_instance().textured;
-    program.use();
-    auto pos = program.getAttribute("in_pos");
-    auto uv = program.getAttribute("in_uv");
-    pos.enable();
-    uv.enable();
-    gl::vertexAttrib(pos, 2, gl::Type::Float, 0 * sizeof(GLfloat), 0);
-    gl::vertexAttrib(uv, 2, gl::Type::Float, 0 * sizeof(GLfloat), 8 * 4);
-    gl::drawArrays(gl::Primitive::TriangleFan, 0, 4);
-    pos.disable();
-    uv.disable();
-}
+namespace {
 
-void draw_quad_invy()
+// 4 positions followed by 4 uvs, drawn as a triangle fan
+using QuadData = std::array<float, 16>;
+
+// Quad geometry that lives for the whole run instead of being uploaded into
+// a new buffer for every draw. Where vertex arrays are available each
+// program gets one that remembers the attribute setup; on GLES2 the
+// attributes are set up for every draw like before.
+template <GLenum Usage> class Quad
 {
-    float x0 = -1;
-    float y0 = -1;
+    struct Binding
+    {
+        gl::VertexArray vao;
+        gl::Attribute pos;
+        gl::Attribute uv;
+    };
+
+    gl::ArrayBuffer<Usage> vbo;
+    std::unordered_map<GLuint, Binding> bindings;
+    uint32_t generation = 0;
+
+    void setup_attribs(Binding const& b) const
+    {
+        gl::vertexAttrib(b.pos, 2, gl::Type::Float, 0, 0);
+        if (b.uv.location >= 0) {
+            gl::vertexAttrib(b.uv, 2, gl::Type::Float, 0, 8 * 4);
+        }
+    }
 
-    float x1 = 1;
-    float y1 = 1;
+public:
+    explicit Quad(QuadData const& data) : vbo{data} {}
+
+    void update(QuadData const& data) { vbo.stream(data.data(), sizeof(data)); }
+
+    void draw(gl::Program const& program)
+    {
+        auto& state = gl::GLState::get();
+        // Program ids can be reused once a program is deleted
+        if (generation != state.program_generation) {
+            bindings.clear();
+            generation = state.program_generation;
+        }
+        auto it = bindings.find(program.program);
+        bool const created = it == bindings.end();
+        if (created) {
+            it = bindings
+                     .emplace(program.program,
+                         Binding{gl::VertexArray{},
+                             program.getAttribute("in_pos"),
+                             program.getAttribute("in_uv")})
+                     .first;
+        }
+        auto const& b = it->second;
+        program.use();
+
+        if (gl::VertexArray::supported()) {
+            b.vao.bind();
+            if (created) {
+                vbo.bind();
+                // Enabled attributes belong to the vertex array, so this
+                // goes around the GLState shadow on purpose
+                glEnableVertexAttribArray(b.pos.location);
+                if (b.uv.location >= 0) {
+                    glEnableVertexAttribArray(b.uv.location);
+                }
+                setup_attribs(b);
+            }
+            gl::drawArrays(gl::Primitive::TriangleFan, 0, 4);
+            gl::VertexArray::unbind();
+            return;
+        }
+
+        vbo.bind();
+        b.pos.enable();
+        b.uv.enable();
+        setup_attribs(b);
+        gl::drawArrays(gl::Primitive::TriangleFan, 0, 4);
+        b.pos.disable();
+        b.uv.disable();
+    }
+};
 
-    std::array vertexData{
-        x0, y0, x1, y0, x1, y1, x0, y1, 0.F, 1.F, 1.F, 1.F, 1.F, 0.F, 0.F, 0.F};
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
+constexpr QuadData full_quad{-1.F, -1.F, 1.F, -1.F, 1.F, 1.F, -1.F, 1.F, 0.F,
+    0.F, 1.F, 0.F, 1.F, 1.F, 0.F, 1.F};
+
+constexpr QuadData full_quad_invy{-1.F, -1.F, 1.F, -1.F, 1.F, 1.F, -1.F, 1.F,
+    0.F, 1.F, 1.F, 1.F, 1.F, 0.F, 0.F, 0.F};
 
-    vbo.bind();
-    draw_with_uvs();
+// Shared by all the positioned draws; given new storage for each one
+Quad<GL_STREAM_DRAW>& stream_quad()
+{
+    static Quad<GL_STREAM_DRAW> quad{full_quad};
+    return quad;
 }
 
-void draw_quad()
+void draw_stream_quad(QuadData const& data)
 {
-    float x0 = -1;
-    float y0 = -1;
+    auto& quad = stream_quad();
+    quad.update(data);
+    quad.draw(gl::Program::current());
+}
 
-    float x1 = 1;
-    float y1 = 1;
+// Shared buffer for the untextured shapes, given new storage for each
+// draw. Big enough for a circle.
+constexpr size_t shape_buffer_size = 256 * 4;
 
-    std::array vertexData{
-        x0, y0, x1, y0, x1, y1, x0, y1, 0.F, 0.F, 1.F, 0.F, 1.F, 1.F, 0.F, 1.F};
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
+gl::ArrayBuffer<GL_STREAM_DRAW>& shape_buffer()
+{
+    static gl::ArrayBuffer<GL_STREAM_DRAW> vbo{shape_buffer_size};
+    return vbo;
+}
 
-    vbo.bind();
-    draw_with_uvs();
+} // namespace
+
+void draw_quad_invy()
+{
+    static Quad<GL_STATIC_DRAW> quad{full_quad_invy};
+    quad.draw(gl::Program::current());
+}
+
+void draw_quad()
+{
+    static Quad<GL_STATIC_DRAW> quad{full_quad};
+    quad.draw(gl::Program::current());
 }
 
 void draw_quad_uvs(std::array<float, 8> const& uvs)
 {
-    std::array vertexData{-1.F, -1.F, 1.F, -1.F, 1.F, 1.F, -1.F, 1.F, 0.F, 0.F,
-        1.F, 0.F, 1.F, 1.F, 0.F, 1.F};
+    auto vertexData = full_quad;
     std::copy(uvs.begin(), uvs.end(), vertexData.begin() + 8);
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
-
-    vbo.bind();
-    draw_with_uvs();
+    draw_stream_quad(vertexData);
 }
 
 void draw_quad_uvs(
@@ -104,11 +180,7 @@ void draw_quad_uvs(
         x0, y0, x1, y0, x1, y1, x0, y1, 0.F, 0.F, 1.F, 0.F, 1.F, 1.F, 0.F, 1.F};
 
     std::copy(uvs.begin(), uvs.end(), vertexData.begin() + 8);
-
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
-
-    vbo.bind();
-    draw_with_uvs();
+    draw_stream_quad(vertexData);
 }
 
 void draw_quad_impl(float x, float y, float sx, float sy)
@@ -126,10 +198,7 @@ void draw_quad_impl(float x, float y, float sx, float sy)
 
     std::array vertexData{
         x0, y0, x1, y0, x1, y1, x0, y1, 0.F, 0.F, 1.F, 0.F, 1.F, 1.F, 0.F, 1.F};
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
-
-    vbo.bind();
-    draw_with_uvs();
+    draw_stream_quad(vertexData);
 }
 
 void draw_quad_filled(float x, float y, float sx, float sy)
@@ -146,9 +215,7 @@ void draw_quad_filled(float x, float y, float sx, float sy)
     auto y1 = y * -2.0F / h + 1.0F;
 
     std::array vertexData{x0, y0, x1, y0, x1, y1, x0, y1};
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
-
-    vbo.bind();
+    shape_buffer().stream(vertexData.data(), sizeof(vertexData));
 
     auto& program = gl::ProgramCache::get_instance().non_textured;
     program.use();
@@ -187,10 +254,7 @@ void draw_line_impl(float x0, float y0, float x1, float y1)
     y1 = y1 * -2.0F / h + 1.0F;
 
     std::array vertexData{x0, y0, x1, y1};
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
-
-    vbo.bind();
-    // glBindBuffer(GL_
+    shape_buffer().stream(vertexData.data(), sizeof(vertexData));
 
     auto& program = gl::ProgramCache::get_instance().non_textured;
     program.use();
@@ -224,9 +288,8 @@ void draw_circle_impl(float x, float y, float radius)
         vertexData.push_back(px);
         vertexData.push_back(py);
     }
-    gl::ArrayBuffer<GL_STREAM_DRAW> vbo{vertexData};
-
-    vbo.bind();
+    shape_buffer().stream(
+        vertexData.data(), vertexData.size() * sizeof(float));
 
     auto& program = gl::ProgramCache::get_instance().non_textured;
     program.use();
@@ -116,19 +116,13 @@ PixConsole::PixConsole(
     uv_texture.bind(1);
     font_texture.bind(0);
 
-    program = gl_wrap::Program(gl_wrap::VertexShader{vertex_shader},
-        gl_wrap::FragmentShader{fragment_shader});
+    // Consoles share the program; size and scale are set in `render()`
+    program = gl_wrap::ProgramRegistry::get().get_program(
+        vertex_shader, fragment_shader);
 
-    program.setUniform("in_tex", 0);
-    program.setUniform("uv_tex", 1);
-    program.setUniform("col_tex", 2);
-
-    program.setUniform("console_size", std::pair<float, float>(w, h));
-    program.setUniform("uv_scale",
-        std::pair<float, float>(
-            static_cast<float>(char_width) / static_cast<float>(texture_width),
-            static_cast<float>(char_height) /
-                static_cast<float>(texture_height)));
+    program->setUniform("in_tex", 0);
+    program->setUniform("uv_tex", 1);
+    program->setUniform("col_tex", 2);
     uv_texture.update(uvdata.data());
 
     for (auto& c : coldata) {
@@ -144,6 +138,7 @@ std::pair<int, int> PixConsole::get_char_size()
 
 void PixConsole::set_tile_size(int w, int h)
 {
+    generation++;
     char_uvs.clear();
     next_pos = {0, 0};
 
@@ -157,12 +152,6 @@ void PixConsole::set_tile_size(int w, int h)
     }
     char_width = w;
     char_height = h;
-    program.use();
-    program.setUniform("uv_scale",
-        std::pair<float, float>(
-            static_cast<float>(char_width) / static_cast<float>(texture_width),
-            static_cast<float>(char_height) /
-                static_cast<float>(texture_height)));
     for (char32_t c = 0x20; c <= 0x7f; c++) {
         add_char(c);
     }
@@ -176,6 +165,7 @@ void PixConsole::reset()
 
 void PixConsole::set_tile_image(char32_t c, gl_wrap::TexRef tex)
 {
+    generation++;
     auto fx = texture_width / 256;
     auto fy = texture_height / 256;
 
@@ -195,11 +185,11 @@ void PixConsole::set_tile_image(char32_t c, gl_wrap::TexRef tex)
     tex.bind();
     tex.yflip();
 
-    glBlendFunc(GL_ONE, GL_ZERO);
+    gl_wrap::blendFunc(GL_ONE, GL_ZERO);
     pix::draw_quad_uvs(pos.first, texture_height - char_height - pos.second,
         char_width, char_height, tex.uvs);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl_wrap::bindFramebuffer(0);
+    gl_wrap::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 }
 
 std::pair<int, int> PixConsole::text(int x, int y, std::string const& t)
@@ -210,6 +200,7 @@ std::pair<int, int> PixConsole::text(int x, int y, std::string const& t)
 std::pair<int, int> PixConsole::text(
     int x, int y, std::string const& t, uint32_t fg, uint32_t bg)
 {
+    generation++;
     auto text32 = utils::utf8_decode(t);
 
     auto [w0, w1] = make_col(fg, bg);
@@ -239,12 +230,15 @@ std::pair<int, int> PixConsole::text(
 
 void PixConsole::flush()
 {
+    if (flushed == generation) { return; }
+    flushed = generation;
     uv_texture.update(uvdata.data());
     col_texture.update(coldata.data());
 }
 
 void PixConsole::put_char(int x, int y, char32_t c)
 {
+    generation++;
     auto it = char_uvs.find(c);
     if (it == char_uvs.end()) {
         add_char(c);
@@ -268,6 +262,7 @@ uint32_t PixConsole::get_char(int x, int y)
 
 void PixConsole::put_color(int x, int y, uint32_t fg, uint32_t bg)
 {
+    generation++;
     auto [w0, w1] = make_col(fg, bg);
     uvdata[x + width * y] = (uvdata[x + width * y] & 0xffff) | w0;
     coldata[x + width * y] = w1;
@@ -275,6 +270,7 @@ void PixConsole::put_color(int x, int y, uint32_t fg, uint32_t bg)
 
 void PixConsole::fill(uint32_t fg, uint32_t bg)
 {
+    generation++;
     auto [w0, w1] = make_col(fg, bg);
     w0 |= char_uvs[' '];
     for (size_t i = 0; i < uvdata.size(); i++) {
@@ -285,6 +281,7 @@ void PixConsole::fill(uint32_t fg, uint32_t bg)
 
 void PixConsole::fill(uint32_t bg)
 {
+    generation++;
     auto [w0, w1] = make_col(0, bg);
     w0 |= char_uvs[' '];
     for (auto& c : coldata) {
@@ -295,6 +292,7 @@ void PixConsole::fill(uint32_t bg)
 void PixConsole::clear_area(
     int32_t x, int32_t y, int32_t w, int32_t h, uint32_t fg, uint32_t bg)
 {
+    generation++;
     if (w == -1) { w = width; }
     if (h == -1) { h = height; }
     auto [w0, w1] = make_col(fg, bg);
@@ -310,6 +308,7 @@ void PixConsole::clear_area(
 
 void PixConsole::scroll(int dy, int dx)
 {
+    generation++;
     // TODO: Optimize
     auto uc = uvdata;
     auto cc = coldata;
@@ -329,11 +328,13 @@ void PixConsole::scroll(int dy, int dx)
 
 void PixConsole::set_scale(std::pair<float, float> s)
 {
+    generation++;
     scale = s;
 }
 
 void PixConsole::set_offset(std::pair<float, float> o)
 {
+    generation++;
     offset = o;
 }
 
@@ -343,7 +344,15 @@ void PixConsole::render()
     col_texture.bind(2);
     uv_texture.bind(1);
     font_texture.bind(0);
-    program.use();
+    program->use();
+    program->setUniform("console_size",
+        std::pair<float, float>(static_cast<float>(width),
+            static_cast<float>(height)));
+    program->setUniform("uv_scale",
+        std::pair<float, float>(
+            static_cast<float>(char_width) / static_cast<float>(texture_width),
+            static_cast<float>(char_height) /
+                static_cast<float>(texture_height)));
     float w = scale.first * static_cast<float>(width * char_width);
     float h = scale.second * static_cast<float>(height * char_height);
     pix::draw_quad_impl(offset.first, offset.second, w, h);
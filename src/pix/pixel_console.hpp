@@ -9,6 +9,7 @@
 #include <pix/font.hpp>
 #include <pix/pix.hpp>
 
+#include <memory>
 #include <string>
 #include <tuple>
 #include <unordered_map>
@@ -32,7 +33,7 @@ class PixConsole
     gl_wrap::Texture font_texture;
     gl_wrap::Texture uv_texture;
     gl_wrap::Texture col_texture;
-    gl_wrap::Program program;
+    std::shared_ptr<gl_wrap::Program> program;
 
     std::vector<uint32_t> uvdata;
     std::vector<uint32_t> coldata;
@@ -43,6 +44,11 @@ class PixConsole
     std::pair<float, float> scale{2.0, 2.0};
     std::pair<float, float> offset{0, 0};
 
+    // Bumped by every change to the contents, so `flush()` only uploads
+    // when needed and owners can tell if the console needs redrawing
+    uint32_t generation = 0;
+    uint32_t flushed = ~0U;
+
     static constexpr std::pair<uint32_t, uint32_t> make_col(
         uint32_t fg, uint32_t bg)
     {
@@ -75,6 +81,8 @@ public:
 
     void flush();
 
+    uint32_t changes() const { return generation; }
+
     void put_char(int x, int y, char32_t c);
 
     uint32_t get_char(int x, int y);
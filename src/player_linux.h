@@ -25,6 +25,8 @@ private:
 class LinuxPlayer
 {
     int hz;
+    int period;
+    int periods;
     std::function<void(int16_t*, size_t)> callback;
     std::atomic<bool> quit{false};
     snd_pcm_t* playback_handle = nullptr;
@@ -32,7 +34,11 @@ class LinuxPlayer
     std::thread player_thread;
 
 public:
-    explicit LinuxPlayer(int hz = 44100) : hz(hz)
+    std::atomic<int> underruns{0};
+
+    // A `period` of 0 asks for the default 30 ms of buffering
+    explicit LinuxPlayer(int hz = 44100, int period = 0, int periods = 2)
+        : hz(hz), period(period), periods(periods)
     {
         player_thread = std::thread{&LinuxPlayer::run, this};
     };
@@ -62,14 +68,28 @@ public:
                 stderr, "cannot open audio device (%s)\n", snd_strerror(err));
             throw sound_exception("");
         }
+        unsigned latency = 30000;
+        if (period > 0) {
+            latency = static_cast<unsigned>(
+                static_cast<int64_t>(period) * periods * 1000000 / hz);
+        }
         if (int err = snd_pcm_set_params(playback_handle, SND_PCM_FORMAT_S16,
-                SND_PCM_ACCESS_RW_INTERLEAVED, 2, hz, 1, 30000);
+                SND_PCM_ACCESS_RW_INTERLEAVED, 2, hz, 1, latency);
             err < 0) {
             fprintf(stderr, "Playback open error: %s\n", snd_strerror(err));
             throw sound_exception("");
         }
 
-        std::vector<int16_t> buffer(8192*8);
+        // Write one period at a time, so we never queue up more than
+        // the device buffer
+        snd_pcm_uframes_t buffer_size = 0;
+        snd_pcm_uframes_t period_size = 0;
+        if (snd_pcm_get_params(playback_handle, &buffer_size, &period_size) <
+                0 ||
+            period_size == 0) {
+            period_size = period > 0 ? period : hz / 100;
+        }
+        std::vector<int16_t> buffer(period_size * 2);
         while (!quit) {
             if (paused) {
                 std::this_thread::sleep_for(10ms);
@@ -91,6 +111,7 @@ public:
         auto frames = snd_pcm_writei(playback_handle,
             reinterpret_cast<char*>(samples), sample_count / 2);
         if (frames < 0) {
+            if (frames == -EPIPE) { underruns++; }
             snd_pcm_recover(playback_handle, static_cast<int>(frames), 0);
         }
     }
@@ -0,0 +1,215 @@
+#include "profiler.hpp"
+
+#include "mrb_tools.hpp"
+
+#include <mruby/debug.h>
+#include <mruby/irep.h>
+#include <mruby/proc.h>
+
+#include <fmt/format.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string_view>
+#include <vector>
+
+bool Profiler::available()
+{
+#if defined(MRB_USE_DEBUG_HOOK) && !defined(__EMSCRIPTEN__)
+    return true;
+#else
+    return false;
+#endif
+}
+
+#ifdef MRB_USE_DEBUG_HOOK
+void Profiler::code_fetch(mrb_state* /*mrb*/, struct mrb_irep const* irep,
+    mrb_code const* pc, mrb_value* /*regs*/)
+{
+    auto* prof = default_profiler;
+    if (!prof->sample_due.load(std::memory_order_relaxed)) { return; }
+    prof->sample_due = false;
+    prof->sample(irep, pc);
+}
+#endif
+
+void Profiler::sample_context(mrb_context* c, struct mrb_irep const* irep,
+    void const* pc, std::vector<std::string>& frames)
+{
+    for (auto* ci = c->cibase; ci <= c->ci; ci++) {
+        // Not mrb_sym_name(), which can allocate a string for the name
+        mrb_int len = 0;
+        auto const* chars =
+            ci->mid != 0 ? mrb_sym_name_len(ruby, ci->mid, &len) : nullptr;
+        std::string_view name = chars != nullptr
+                                    ? std::string_view(chars, len)
+                                    : std::string_view("<main>");
+        if (ci->proc == nullptr || MRB_PROC_CFUNC_P(ci->proc)) {
+            frames.push_back(fmt::format("{} (native)", name));
+            continue;
+        }
+        auto const* frame_irep = ci->proc->body.irep;
+        auto const* frame_pc = ci->pc;
+        // The saved pc of the running frame is stale, use the one we got
+        if (c == ruby->c && ci == c->ci) {
+            frame_irep = irep;
+            frame_pc = static_cast<mrb_code const*>(pc);
+        }
+        if (frame_pc == nullptr || frame_irep == nullptr) {
+            frames.emplace_back(name);
+            continue;
+        }
+        auto offset = static_cast<uint32_t>(frame_pc - frame_irep->iseq);
+        auto const* file = mrb_debug_get_filename(ruby, frame_irep, offset);
+        auto line = mrb_debug_get_line(ruby, frame_irep, offset);
+        frames.push_back(fmt::format(
+            "{} ({}:{})", name, file != nullptr ? file : "?", line));
+    }
+}
+
+// Called from inside the VM between two instructions, so the call stack
+// is consistent. Must not allocate ruby objects.
+void Profiler::sample(struct mrb_irep const* irep, void const* pc)
+{
+    // Include the stacks of the fibers that resumed the current one
+    std::vector<mrb_context*> contexts;
+    for (auto* c = ruby->c; c != nullptr; c = c->prev) {
+        contexts.push_back(c);
+    }
+    std::vector<std::string> frames;
+    for (auto ctx = contexts.rbegin(); ctx != contexts.rend(); ++ctx) {
+        sample_context(*ctx, irep, pc, frames);
+    }
+    if (frames.empty()) { return; }
+
+    std::string key;
+    for (auto const& f : frames) {
+        if (!key.empty()) { key += ';'; }
+        key += f;
+    }
+    stacks[key]++;
+    self_count[frames.back()]++;
+    // Count recursive frames once
+    std::sort(frames.begin(), frames.end());
+    frames.erase(std::unique(frames.begin(), frames.end()), frames.end());
+    for (auto const& f : frames) {
+        total_count[f]++;
+    }
+    samples++;
+}
+
+void Profiler::start(int hz)
+{
+    if (!available() || running) { return; }
+    stacks.clear();
+    self_count.clear();
+    total_count.clear();
+    samples = 0;
+    interval = std::chrono::microseconds(1000000 / std::max(hz, 1));
+    running = true;
+    timer_thread = std::thread([this] {
+        while (running) {
+            std::this_thread::sleep_for(interval);
+            sample_due = true;
+        }
+    });
+#ifdef MRB_USE_DEBUG_HOOK
+    ruby->code_fetch_hook = &code_fetch;
+#endif
+}
+
+void Profiler::stop()
+{
+    if (!running) { return; }
+#ifdef MRB_USE_DEBUG_HOOK
+    ruby->code_fetch_hook = nullptr;
+#endif
+    running = false;
+    if (timer_thread.joinable()) { timer_thread.join(); }
+    sample_due = false;
+}
+
+bool Profiler::write_folded(std::filesystem::path const& file_name) const
+{
+    std::ofstream out{file_name};
+    if (!out) { return false; }
+    for (auto const& [stack, count] : stacks) {
+        out << stack << ' ' << count << '\n';
+    }
+    return true;
+}
+
+std::string Profiler::top(size_t n) const
+{
+    std::vector<std::pair<std::string, int>> sorted(
+        self_count.begin(), self_count.end());
+    std::sort(sorted.begin(), sorted.end(),
+        [](auto const& a, auto const& b) { return a.second > b.second; });
+    if (sorted.size() > n) { sorted.resize(n); }
+
+    auto percent = [&](int count) {
+        return samples > 0 ? 100.0 * count / samples : 0.0;
+    };
+    auto result = fmt::format("{} samples\n  self  total\n", samples);
+    for (auto const& [frame, count] : sorted) {
+        auto it = total_count.find(frame);
+        auto total = it != total_count.end() ? it->second : count;
+        result += fmt::format("{:5.1f}% {:5.1f}%  {}\n", percent(count),
+            percent(total), frame);
+    }
+    return result;
+}
+
+void Profiler::reg_class(mrb_state* ruby)
+{
+    default_profiler = new Profiler(ruby);
+
+    auto* rclass = mrb_define_module(ruby, "Profiler");
+
+    mrb_define_module_function(
+        ruby, rclass, "available?",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            return mrb::to_value(available(), mrb);
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_module_function(
+        ruby, rclass, "start",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            mrb_int hz = 1000;
+            mrb_get_args(mrb, "|i", &hz);
+            if (!available()) {
+                mrb_raise(mrb, E_RUNTIME_ERROR,
+                    "mruby was built without MRB_USE_DEBUG_HOOK");
+            }
+            default_profiler->start(static_cast<int>(hz));
+            return mrb_nil_value();
+        },
+        MRB_ARGS_OPT(1));
+
+    // Stop profiling; write collapsed stacks to `file_name` if given and
+    // return the table of the `n` hottest frames
+    mrb_define_module_function(
+        ruby, rclass, "stop",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            char const* file_name = nullptr;
+            mrb_int n = 20;
+            mrb_get_args(mrb, "|z!i", &file_name, &n);
+            auto* prof = default_profiler;
+            prof->stop();
+            if (file_name != nullptr && !prof->write_folded(file_name)) {
+                fmt::print("Could not write {}\n", file_name);
+            }
+            auto table = prof->top(static_cast<size_t>(n));
+            fmt::print("{}", table);
+            return mrb::to_value(table, mrb);
+        },
+        MRB_ARGS_OPT(2));
+
+    mrb_define_module_function(
+        ruby, rclass, "active?",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            return mrb::to_value(default_profiler->active(), mrb);
+        },
+        MRB_ARGS_NONE());
+}
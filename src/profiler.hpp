@@ -0,0 +1,58 @@
+#pragma once
+
+#include <mruby.h>
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Sampling profiler for ruby code. A timer thread marks when a sample is
+// due, and the next instruction fetched by the VM records the call stack.
+// Needs mruby built with MRB_USE_DEBUG_HOOK (`make PROFILER=1`). That
+// makes the VM check for a hook before every instruction even when not
+// profiling, so it is not in normal builds.
+class Profiler
+{
+    mrb_state* ruby;
+    std::thread timer_thread;
+    std::atomic<bool> running{false};
+    std::atomic<bool> sample_due{false};
+    std::chrono::microseconds interval{1000};
+
+    // Collapsed stacks ("outer;inner") and how often each was seen
+    std::unordered_map<std::string, int> stacks;
+    // Samples where a frame was at the top of the stack / anywhere in it
+    std::unordered_map<std::string, int> self_count;
+    std::unordered_map<std::string, int> total_count;
+    int samples = 0;
+
+#ifdef MRB_USE_DEBUG_HOOK
+    static void code_fetch(mrb_state* mrb, struct mrb_irep const* irep,
+        mrb_code const* pc, mrb_value* regs);
+#endif
+    void sample(struct mrb_irep const* irep, void const* pc);
+    void sample_context(mrb_context* c, struct mrb_irep const* irep,
+        void const* pc, std::vector<std::string>& frames);
+
+public:
+    explicit Profiler(mrb_state* _ruby) : ruby{_ruby} {}
+    ~Profiler() { stop(); }
+
+    static bool available();
+    bool active() const { return running; }
+
+    void start(int hz = 1000);
+    void stop();
+
+    // Write collapsed stacks, as used by flamegraph.pl and speedscope
+    bool write_folded(std::filesystem::path const& file_name) const;
+    // Table of the `n` frames with most samples
+    std::string top(size_t n) const;
+
+    static inline Profiler* default_profiler = nullptr;
+    static void reg_class(mrb_state* ruby);
+};
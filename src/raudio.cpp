@@ -1,65 +1,689 @@
 #include "raudio.hpp"
 
+#include <mruby/hash.h>
+
+#include <algorithm>
+#include <chrono>
+
 #define DR_WAV_IMPLEMENTATION
 #include <dr_libs/dr_wav.h>
 
 mrb_data_type Sound::dt{
     "Sound", [](mrb_state*, void* ptr) { delete static_cast<Sound*>(ptr); }};
 
+mrb_data_type Synth::dt{
+    "Synth", [](mrb_state*, void* ptr) { delete static_cast<Synth*>(ptr); }};
+
+mrb_data_type Voice::dt{
+    "Voice", [](mrb_state*, void* ptr) { delete static_cast<Voice*>(ptr); }};
+
+mrb_data_type Tracker::dt{"Tracker",
+    [](mrb_state*, void* ptr) { delete static_cast<Tracker*>(ptr); }};
+
+mrb_data_type Stream::dt{
+    "Stream", [](mrb_state*, void* ptr) { delete static_cast<Stream*>(ptr); }};
+
 RAudio::RAudio(mrb_state* _ruby, System& _system, Settings const& settings)
     : system{_system}
 {
+    pending.reserve(max_pending);
     system.init_audio(settings);
-    system.set_audio_callback([this](float* data, size_t size) {
-        while (out_buffer.available() < size) {
-            mix(2048);
+    system.set_audio_callback(
+        [this](float* data, size_t size) { audio_callback(data, size); });
+}
+
+// Runs in the audio thread. This is the only place where we mix, and it
+// must never block
+void RAudio::audio_callback(float* data, size_t size)
+{
+    using clk = std::chrono::steady_clock;
+    using std::chrono::duration_cast;
+    using std::chrono::microseconds;
+
+    auto start = clk::now();
+    auto frames = size / 2;
+    block_size = std::clamp(frames, min_block, max_block);
+
+    while (size > 0) {
+        if (out_buffer.available() == 0) {
+            auto t = clk::now();
+            apply_commands();
+            mix(block_size);
+            auto us = static_cast<int>(
+                duration_cast<microseconds>(clk::now() - t).count());
+            stats.mix_time = us;
+            if (us > stats.max_mix_time) { stats.max_mix_time = us; }
         }
-        out_buffer.read(data, size);
-    });
+        auto n = out_buffer.read(data, size);
+        data += n;
+        size -= n;
+    }
+
+    stats.period = static_cast<int>(frames);
+    stats.fill = static_cast<int>(out_buffer.available() / 2);
+    auto elapsed = duration_cast<microseconds>(clk::now() - start).count();
+    if (static_cast<size_t>(elapsed) > frames * 1000000 / 44100) {
+        stats.late++;
+    }
 }
 
+// Called from main thread every frame
 void RAudio::update()
 {
-    while (out_buffer.available() < 2048) {
-        mix(2048 / 2);
+    // Popping into `ptr` drops the reference it held before
+    std::shared_ptr<void const> ptr;
+    while (retired.pop(ptr)) {}
+#ifdef __EMSCRIPTEN__
+    // No decoder thread
+    decoder.poll();
+#endif
+}
+
+void RAudio::send(Command&& cmd, uint64_t time)
+{
+    if (!commands.push(Message{time, std::move(cmd)})) {
+        fmt::print("Audio command queue full\n");
+    }
+}
+
+void RAudio::apply(PlayCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    retire(chan);
+    chan.id = cmd.id;
+    // If retiring failed the old buffer is released here, which is not
+    // ideal but only happens if the main thread has stopped updating.
+    chan.buffer = std::move(cmd.buffer);
+    chan.stream = nullptr;
+    chan.synth.stop();
+    chan.data = cmd.data;
+    chan.format = cmd.format;
+    chan.size = cmd.size;
+    chan.pos = 0;
+    chan.step = cmd.step;
+    chan.loop = cmd.loop;
+    chan.gain = cmd.gain;
+    chan.spread = cmd.spread;
+    chan.update_gains();
+}
+
+void RAudio::apply(StreamCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    retire(chan);
+    chan.id = cmd.id;
+    chan.buffer = nullptr;
+    chan.data = nullptr;
+    chan.size = 0;
+    chan.stream = std::move(cmd.stream);
+    chan.synth.stop();
+    chan.plane = cmd.plane;
+    chan.last = 0;
+    chan.pos = 0;
+    chan.step = cmd.step;
+    chan.loop = false;
+    chan.gain = 1.0F;
+    chan.spread = cmd.spread;
+    chan.update_gains();
+}
+
+// Hand sample data back to the main thread for releasing
+void RAudio::retire(Channel& chan)
+{
+    // Copy the reference first; if the queue is full the channel still
+    // holds on to it and we try again later.
+    if (std::shared_ptr<void const> ptr = chan.buffer;
+        ptr && retired.push(std::move(ptr))) {
+        chan.buffer = nullptr;
+        chan.data = nullptr;
+        chan.size = 0;
+    }
+    if (std::shared_ptr<void const> ptr = chan.stream;
+        ptr && retired.push(std::move(ptr))) {
+        chan.stream = nullptr;
+    }
+}
+
+void RAudio::apply(FreqCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    // A synth voice has no sample to step through, and a non zero step
+    // would keep the channel active after the note ends
+    if (chan.synth.active()) {
+        chan.synth.set_freq(cmd.step * 44100.F);
+    } else if (chan.data != nullptr || chan.stream) {
+        chan.step = cmd.step;
+    }
+}
+
+void RAudio::apply(StopCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    chan.step = 0;
+    chan.synth.stop();
+}
+
+void RAudio::apply(NoteOnCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    chan.id = cmd.id;
+    // Stop any sample; its buffer is retired after the next block
+    chan.step = 0;
+    chan.synth.note_on(cmd.patch, cmd.freq, cmd.velocity);
+    chan.spread = 0;
+    chan.update_gains();
+}
+
+void RAudio::apply(NoteOffCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    // The voice was stolen before its release came due
+    if (cmd.id != 0 && cmd.id != chan.id) { return; }
+    chan.synth.note_off();
+}
+
+void RAudio::apply(VolumeCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    chan.volume = cmd.volume;
+    chan.update_gains();
+}
+
+void RAudio::apply(PanCmd& cmd)
+{
+    auto& chan = channels[cmd.channel];
+    chan.pan = cmd.pan;
+    chan.update_gains();
+}
+
+void RAudio::apply(BusCmd& cmd)
+{
+    bus.set(cmd.params);
+}
+
+void RAudio::apply(MusicCmd& cmd)
+{
+    retire_music();
+    music = std::move(cmd.player);
+}
+
+void RAudio::retire_music()
+{
+    if (std::shared_ptr<void const> ptr = music;
+        ptr && retired.push(std::move(ptr))) {
+        music = nullptr;
+    }
+}
+
+// Apply a command that is due, or put it in the heap. Returns false if
+// there is no room for it; it must never be applied early.
+bool RAudio::take(Message& msg)
+{
+    if (msg.time <= sample_time) {
+        std::visit([&](auto& c) { apply(c); }, msg.cmd);
+        return true;
+    }
+    if (pending.size() >= max_pending) { return false; }
+    pending.push_back({msg.time, pending_order++, std::move(msg.cmd)});
+    std::push_heap(pending.begin(), pending.end());
+    return true;
+}
+
+void RAudio::apply_commands()
+{
+    if (held) {
+        if (!take(*held)) {
+            stats.deferred++;
+            return;
+        }
+        held.reset();
+    }
+    Message msg;
+    while (commands.pop(msg)) {
+        if (!take(msg)) {
+            held = std::move(msg);
+            stats.deferred++;
+            return;
+        }
+    }
+}
+
+// Apply all sequenced commands that should happen before `until`
+void RAudio::apply_pending(uint64_t until)
+{
+    while (!pending.empty() && pending.front().time <= until) {
+        std::pop_heap(pending.begin(), pending.end());
+        std::visit([&](auto& c) { apply(c); }, pending.back().cmd);
+        pending.pop_back();
+    }
+}
+
+// Render each active channel into a mono block, then add it to both sides
+// with the channels gains. Keeping the per sample work separate from the
+// panning lets the compiler vectorize the latter.
+void RAudio::mix_channels(float* left, float* right, size_t start, size_t end)
+{
+    std::array<float, max_block> mono; // NOLINT
+    for (size_t c = 0; c < channels.size(); c++) {
+        auto& chan = channels[c];
+        if (!chan.active()) {
+            levels[c] = 0.0F;
+            continue;
+        }
+        chan.read_block(mono.data() + start, end - start);
+        auto lg = chan.left_gain;
+        auto rg = chan.right_gain;
+        float peak = 0;
+        for (size_t i = start; i < end; i++) {
+            left[i] += mono[i] * lg;
+            right[i] += mono[i] * rg;
+            peak = std::max(peak, std::abs(mono[i]));
+        }
+        // Keep it above 0 as long as the channel is active
+        levels[c] = std::max(peak * chan.volume, 1.0e-6F);
     }
+    if (music) { music->render(left + start, right + start, end - start); }
 }
 
-// Pull 'count' samples from all channels into out buffer
+// Pull 'count' samples from all channels into out buffer. The block is
+// split at the exact sample where a sequenced command should take effect.
 void RAudio::mix(size_t samples_len)
 {
-    //fmt::print("Mix {}\n", samples_len);
-    std::array<float, 8192> temp[2]{{}, {}}; // NOLINT
-    int ear = 0;
-    for (auto& chan : channels) {
-        auto& t = temp[ear];
-        ear ^= 1;
-        for (size_t i = 0; i < samples_len; i++) {
-            t[i] += chan.read();
+    std::array<float, max_block> temp[2]{{}, {}}; // NOLINT
+    uint64_t now = sample_time;
+    size_t pos = 0;
+    while (pos < samples_len) {
+        apply_pending(now + pos);
+        size_t end = samples_len;
+        if (!pending.empty() && pending.front().time < now + end) {
+            end = static_cast<size_t>(pending.front().time - now);
         }
+        mix_channels(temp[0].data(), temp[1].data(), pos, end);
+        pos = end;
+    }
+    for (auto& chan : channels) {
+        if (chan.step == 0) { retire(chan); }
     }
+    if (music && music->done()) { retire_music(); }
+    bus.process(temp[0].data(), temp[1].data(), samples_len);
+    sample_time = now + samples_len;
     out_buffer.interleave(temp[0].data(), temp[1].data(), samples_len);
 }
 
-void RAudio::set_sound(int channel, Sound const& sound, float freq, bool loop)
+// Mono is centered, stereo planes go left and right
+static float plane_spread(size_t plane, unsigned channels)
 {
-    if (sound.data.empty()) {
-        return;
-    }
+    if (channels < 2) { return 0.0F; }
+    return plane == 0 ? -1.0F : 1.0F;
+}
+
+// How many output samples a sound plays for at `step`
+static uint64_t play_length(size_t frames, float step)
+{
+    if (step <= 0) { return 0; }
+    return static_cast<uint64_t>(static_cast<float>(frames) / step) + 1;
+}
+
+// How long a note keeps sounding after its note off
+static uint64_t release_time(Patch const& patch)
+{
+    return static_cast<uint64_t>(std::max(patch.release, 0.0F) * 44100.0F);
+}
+
+void RAudio::set_sound(int channel, Sound const& sound, float freq, bool loop,
+    float velocity, uint64_t time)
+{
+    if (sound.empty()) { return; }
     // Assume sample is C4 = 261.63 Hz
     if (freq == 0) { freq = 261.63F; }
     freq = sound.freq * (freq / 261.63F);
     for (size_t i = 0; i < sound.channels; i++) {
-        auto& chan = channels[(channel + i) % 32];
-        chan.set(freq, sound.channel(i), sound.frames());
-        chan.loop = loop;
+        auto c = static_cast<int>((channel + i) % 32);
+        auto id = claim(c, sound.priority, sound.data.get(), time);
+        if (!loop) {
+            voices[c].end =
+                voices[c].start + play_length(sound.frames(), freq / 44100.F);
+        }
+        send(PlayCmd{c, id, sound.data, sound.channel(i), sound.format(),
+                 sound.frames(),
+                 freq / 44100.F, loop,
+                 velocity, plane_spread(i, sound.channels)},
+            time);
+    }
+}
+
+void RAudio::set_stream(
+    int channel, std::shared_ptr<AudioStream> const& stream)
+{
+    for (unsigned i = 0; i < stream->channels; i++) {
+        auto c = static_cast<int>((channel + i) % 32);
+        auto id = claim(c, 0, stream.get());
+        send(StreamCmd{c, id, stream,
+            static_cast<int>(i), stream->freq / 44100.F,
+            plane_spread(i, stream->channels)});
+    }
+}
+
+void RAudio::add_stream(std::shared_ptr<AudioStream> const& stream)
+{
+    decoder.add(stream);
+}
+
+uint32_t RAudio::claim(
+    int channel, int priority, void const* group, uint64_t time, uint32_t id)
+{
+    if (id == 0) {
+        id = next_voice_id++;
+        if (next_voice_id == 0) { next_voice_id = 1; }
+    }
+    auto& v = voices[channel % 32];
+    v.id = id;
+    v.priority = priority;
+    v.group = group;
+    v.start = std::max<uint64_t>(time, sample_time);
+    v.end = UINT64_MAX;
+    v.release = 0;
+    return v.id;
+}
+
+bool RAudio::owns(int channel, uint32_t id) const
+{
+    return channel >= 0 && channel < 32 && voices[channel].id == id;
+}
+
+// A channel is busy if it is playing, or if it was claimed and the audio
+// thread has not mixed a block since (or the voice starts in the future).
+// Voices known to be done by `time` don't count, so notes booked ahead
+// can reuse the channels of earlier notes.
+bool RAudio::busy(int channel, uint64_t time) const
+{
+    auto const& v = voices[channel];
+    if (v.id == 0 || v.end <= std::max<uint64_t>(time, sample_time)) {
+        return false;
+    }
+    return v.start >= sample_time || levels[channel] > 0;
+}
+
+// Free all channels of voice `id`, and remember them in `freed`
+void RAudio::drop_voice(uint32_t id, std::vector<int>& freed)
+{
+    for (int c = 0; c < 32; c++) {
+        if (voices[c].id == id) {
+            voices[c].id = 0;
+            freed.push_back(c);
+        }
+    }
+}
+
+// Steal the lowest priority voice; the quietest, and then the oldest,
+// of those. A voice booked to start later than this one can't be
+// stolen, since its own start would cut this one off.
+int RAudio::steal(int priority, uint64_t time, uint32_t id) const
+{
+    auto now = std::max<uint64_t>(time, sample_time);
+    int best = -1;
+    for (int c = 0; c < 32; c++) {
+        auto const& v = voices[c];
+        if (v.id == id || v.priority > priority || v.start > now) {
+            continue;
+        }
+        if (best < 0) {
+            best = c;
+            continue;
+        }
+        auto const& b = voices[best];
+        float level = levels[c];
+        float best_level = levels[best];
+        if (v.priority != b.priority) {
+            if (v.priority < b.priority) { best = c; }
+        } else if (level != best_level) {
+            if (level < best_level) { best = c; }
+        } else if (v.start < b.start) {
+            best = c;
+        }
+    }
+    return best;
+}
+
+Voice RAudio::allocate(int priority, void const* group, int max_voices,
+    uint64_t time, unsigned planes)
+{
+    // Put back if we can't get all planes
+    auto before = voices;
+    // Channels of replaced or stolen voices
+    std::vector<int> freed;
+    auto now = std::max<uint64_t>(time, sample_time);
+
+    // Too many voices of this sound; replace the oldest, all its planes
+    if (max_voices > 0 && group != nullptr) {
+        std::vector<uint32_t> ids;
+        int oldest = -1;
+        for (int c = 0; c < 32; c++) {
+            auto const& v = voices[c];
+            if (v.group != group || !busy(c, time)) { continue; }
+            if (std::find(ids.begin(), ids.end(), v.id) == ids.end()) {
+                ids.push_back(v.id);
+            }
+            if (v.start <= now &&
+                (oldest < 0 || v.start < voices[oldest].start)) {
+                oldest = c;
+            }
+        }
+        if (static_cast<int>(ids.size()) >= max_voices) {
+            if (oldest < 0) { return {}; }
+            drop_voice(voices[oldest].id, freed);
+        }
+    }
+
+    // All planes share one id, so they are one voice
+    Voice voice;
+    uint32_t id = 0;
+    for (unsigned i = 0; i < std::min(planes, 2U); i++) {
+        int chan = -1;
+        for (auto c : freed) {
+            if (voices[c].id == 0) {
+                chan = c;
+                break;
+            }
+        }
+        for (int c = 0; c < 32 && chan < 0; c++) {
+            if (!busy(c, time)) { chan = c; }
+        }
+        if (chan < 0) {
+            chan = steal(priority, time, id);
+            if (chan < 0) {
+                voices = before;
+                return {};
+            }
+            drop_voice(voices[chan].id, freed);
+        }
+        id = claim(chan, priority, group, time, id);
+        voice.channels[i] = chan;
+        voice.ids[i] = id;
+    }
+
+    // Silence what is left of the voices we took channels from
+    for (auto c : freed) {
+        if (voices[c].id == 0) { send(StopCmd{c}, time); }
+    }
+    return voice;
+}
+
+Voice RAudio::play_sound(
+    Sound const& sound, float freq, float velocity, uint64_t time)
+{
+    Voice voice;
+    if (sound.empty()) { return voice; }
+    auto n = std::min(sound.channels, 2U);
+    if (freq == 0) { freq = 261.63F; }
+    auto step = sound.freq * (freq / 261.63F) / 44100.F;
+    voice = allocate(
+        sound.priority, sound.data.get(), sound.max_voices, time, n);
+    if (voice.channels[0] < 0) { return voice; }
+    for (unsigned i = 0; i < n; i++) {
+        auto& v = voices[voice.channels[i]];
+        v.end = v.start + play_length(sound.frames(), step);
+    }
+    for (unsigned i = 0; i < n; i++) {
+        send(PlayCmd{voice.channels[i], voice.ids[i], sound.data,
+                 sound.channel(i), sound.format(), sound.frames(), step,
+                 false, velocity, plane_spread(i, sound.channels)},
+            time);
     }
+    return voice;
+}
+
+Voice RAudio::play_stream(std::shared_ptr<AudioStream> const& stream)
+{
+    auto n = std::min(stream->channels, 2U);
+    auto voice = allocate(0, stream.get(), 0, 0, n);
+    if (voice.channels[0] < 0) { return voice; }
+    for (unsigned i = 0; i < n; i++) {
+        send(StreamCmd{voice.channels[i], voice.ids[i], stream,
+            static_cast<int>(i), stream->freq / 44100.F,
+            plane_spread(i, stream->channels)});
+    }
+    return voice;
+}
+
+Voice RAudio::play_note(
+    Synth const& synth, float freq, float velocity, uint64_t time)
+{
+    auto voice = allocate(synth.priority, &synth, synth.max_voices, time);
+    auto c = voice.channels[0];
+    if (c < 0) { return voice; }
+    voices[c].release = release_time(synth.patch);
+    send(NoteOnCmd{c, voice.ids[0], synth.patch, freq, velocity}, time);
+    return voice;
 }
 
 void RAudio::set_frequency(int channel, int hz)
 {
-    auto& chan = channels[channel];
-    chan.step = static_cast<float>(hz) / 44100.F;
+    send(FreqCmd{channel % 32, static_cast<float>(hz) / 44100.F});
+}
+
+void RAudio::stop(int channel)
+{
+    send(StopCmd{channel % 32});
+}
+
+uint32_t RAudio::note_on(int channel, Patch const& patch, float freq,
+    float velocity, uint64_t time)
+{
+    auto id = claim(channel % 32, 0, nullptr, time);
+    voices[channel % 32].release = release_time(patch);
+    send(NoteOnCmd{channel % 32, id, patch, freq, velocity}, time);
+    return id;
+}
+
+void RAudio::note_off(int channel, uint64_t time, uint32_t id)
+{
+    auto& v = voices[channel % 32];
+    if (id == 0 || v.id == id) {
+        v.end = std::max<uint64_t>(time, sample_time) + v.release;
+    }
+    send(NoteOffCmd{channel % 32, id}, time);
+}
+
+void RAudio::set_volume(int channel, float volume)
+{
+    send(VolumeCmd{channel % 32, std::max(volume, 0.0F)});
+}
+
+void RAudio::set_pan(int channel, float pan)
+{
+    send(PanCmd{channel % 32, std::clamp(pan, -1.0F, 1.0F)});
+}
+
+void RAudio::set_bus(BusParams const& params)
+{
+    bus_params = params;
+    send(BusCmd{params});
+}
+
+void RAudio::play_music(std::shared_ptr<ModData const> const& mod, bool loop)
+{
+    send(MusicCmd{std::make_shared<ModPlayer>(mod, loop)});
+}
+
+void RAudio::stop_music()
+{
+    send(MusicCmd{});
+}
+
+double RAudio::get_beat() const
+{
+    return (static_cast<double>(sample_time) - beat_origin) * tempo /
+           (60.0 * 44100.0);
+}
+
+void RAudio::set_tempo(double bpm)
+{
+    // Keep the current beat where it is, and change the speed from here
+    auto beat = get_beat();
+    tempo = bpm;
+    beat_origin =
+        static_cast<double>(sample_time) - beat * 60.0 * 44100.0 / bpm;
+}
+
+uint64_t RAudio::beat_to_time(double beat) const
+{
+    auto t = beat_origin + beat * 60.0 * 44100.0 / tempo;
+    // Time 0 means 'now', so make sure we never return that
+    return t < 1.0 ? 1 : static_cast<uint64_t>(t);
+}
+
+// True if argument `i` is an integer. Tells calls with an explicit
+// channel from calls that should allocate a voice.
+static bool int_arg(mrb_state* mrb, mrb_int i)
+{
+    mrb_value* argv = nullptr;
+    mrb_int argc = 0;
+    mrb_get_args(mrb, "*", &argv, &argc);
+    return i < argc && mrb_fixnum_p(argv[i]);
+}
+
+static mrb_value voice_value(mrb_state* mrb, Voice const& voice)
+{
+    if (voice.channels[0] < 0) { return mrb_nil_value(); }
+    return mrb::new_data_obj(mrb, new Voice(voice));
+}
+
+// Interleaved frames to one plane per channel
+template <typename T>
+static std::vector<T> deinterleave(
+    std::vector<T> const& in, unsigned channels, size_t frames)
+{
+    std::vector<T> out(frames * channels);
+    for (size_t i = 0; i < frames; i++) {
+        for (size_t j = 0; j < channels; j++) {
+            out[j * frames + i] = in[i * channels + j];
+        }
+    }
+    return out;
+}
+
+static Wave to_wave(mrb_state* mrb, mrb_sym sym)
+{
+    std::string s{mrb_sym_name(mrb, sym)};
+    if (s == "sine") { return Wave::Sine; }
+    if (s == "square") { return Wave::Square; }
+    if (s == "saw") { return Wave::Saw; }
+    if (s == "triangle") { return Wave::Triangle; }
+    if (s == "noise") { return Wave::Noise; }
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "Unknown wave form");
+    return Wave::Sine;
+}
+
+static FilterType to_filter(mrb_state* mrb, mrb_sym sym)
+{
+    std::string s{mrb_sym_name(mrb, sym)};
+    if (s == "none") { return FilterType::None; }
+    if (s == "low") { return FilterType::LowPass; }
+    if (s == "high") { return FilterType::HighPass; }
+    if (s == "band") { return FilterType::BandPass; }
+    mrb_raise(mrb, E_ARGUMENT_ERROR, "Unknown filter type");
+    return FilterType::None;
 }
 
 void RAudio::reg_class(
@@ -67,8 +691,16 @@ void RAudio::reg_class(
 {
     rclass = mrb_define_class(ruby, "Audio", ruby->object_class);
     Sound::rclass = mrb_define_class(ruby, "Sound", ruby->object_class);
+    Stream::rclass = mrb_define_class(ruby, "Stream", ruby->object_class);
+    Synth::rclass = mrb_define_class(ruby, "Synth", ruby->object_class);
+    Voice::rclass = mrb_define_class(ruby, "Voice", ruby->object_class);
+    Tracker::rclass = mrb_define_class(ruby, "Tracker", ruby->object_class);
     MRB_SET_INSTANCE_TT(RAudio::rclass, MRB_TT_DATA);
     MRB_SET_INSTANCE_TT(Sound::rclass, MRB_TT_DATA);
+    MRB_SET_INSTANCE_TT(Stream::rclass, MRB_TT_DATA);
+    MRB_SET_INSTANCE_TT(Synth::rclass, MRB_TT_DATA);
+    MRB_SET_INSTANCE_TT(Voice::rclass, MRB_TT_DATA);
+    MRB_SET_INSTANCE_TT(Tracker::rclass, MRB_TT_DATA);
 
     default_audio = new RAudio(ruby, system, settings);
 
@@ -86,28 +718,497 @@ void RAudio::reg_class(
         },
         MRB_ARGS_NONE());
 
+    mrb_define_method(
+        ruby, Sound::rclass, "format",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* sound = mrb::self_to<Sound>(self);
+            if (sound->data == nullptr) { return mrb_nil_value(); }
+            static constexpr std::array names{"float", "int16", "uint8"};
+            return mrb_symbol_value(mrb_intern_cstr(
+                mrb, names[static_cast<int>(sound->format())]));
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, Synth::rclass, "initialize",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            mrb_sym wave = mrb_intern_lit(mrb, "square");
+            mrb_get_args(mrb, "|n", &wave);
+            auto* synth = new Synth(); // NOLINT
+            synth->patch.wave = to_wave(mrb, wave);
+            DATA_PTR(self) = synth;                       // NOLINT
+            DATA_TYPE(self) = mrb::get_data_type<Synth>(); // NOLINT
+            return mrb_nil_value();
+        },
+        MRB_ARGS_OPT(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "wave=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            mrb_sym wave{};
+            mrb_get_args(mrb, "n", &wave);
+            mrb::self_to<Synth>(self)->patch.wave = to_wave(mrb, wave);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "pulse_width=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [pw] = mrb::get_args<float>(mrb);
+            mrb::self_to<Synth>(self)->patch.pulse_width =
+                std::clamp(pw, 0.01F, 0.99F);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "volume=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [vol] = mrb::get_args<float>(mrb);
+            mrb::self_to<Synth>(self)->patch.volume = vol;
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "envelope",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [a, d, s, r] = mrb::get_args<float, float, float, float>(mrb);
+            auto& patch = mrb::self_to<Synth>(self)->patch;
+            patch.attack = a;
+            patch.decay = d;
+            patch.sustain = std::clamp(s, 0.0F, 1.0F);
+            patch.release = r;
+            return self;
+        },
+        MRB_ARGS_REQ(4));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "filter",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            mrb_sym type{};
+            mrb_float cutoff = 2000;
+            mrb_float resonance = 0;
+            mrb_get_args(mrb, "n|ff", &type, &cutoff, &resonance);
+            auto& patch = mrb::self_to<Synth>(self)->patch;
+            patch.filter = to_filter(mrb, type);
+            patch.cutoff = static_cast<float>(cutoff);
+            patch.resonance = static_cast<float>(resonance);
+            return self;
+        },
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
+
+    // note_on([channel,] synth, freq, velocity = 1)
+    // Without a channel, a voice is allocated and returned
+    mrb_define_method(
+        ruby, RAudio::rclass, "note_on",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            mrb_int chan = -1;
+            Synth* synth{};
+            mrb_float freq = 0;
+            mrb_float velocity = 1.0;
+            if (int_arg(mrb, 0)) {
+                mrb_get_args(mrb, "idf|f", &chan, &synth, &Synth::dt, &freq,
+                    &velocity);
+                audio->note_on(chan, synth->patch, static_cast<float>(freq),
+                    static_cast<float>(velocity));
+                return self;
+            }
+            mrb_get_args(
+                mrb, "df|f", &synth, &Synth::dt, &freq, &velocity);
+            return voice_value(mrb,
+                audio->play_note(*synth, static_cast<float>(freq),
+                    static_cast<float>(velocity)));
+        },
+        MRB_ARGS_REQ(2) | MRB_ARGS_OPT(2));
+
+    mrb_define_method(
+        ruby, RAudio::rclass, "note_off",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [chan] = mrb::get_args<int>(mrb);
+            mrb::self_to<RAudio>(self)->note_off(chan);
+            return self;
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "channels",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            return mrb::to_value(1, mrb);
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, RAudio::rclass, "tempo=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [bpm] = mrb::get_args<float>(mrb);
+            if (bpm > 0) { mrb::self_to<RAudio>(self)->set_tempo(bpm); }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, RAudio::rclass, "tempo",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            return mrb::to_value(mrb::self_to<RAudio>(self)->tempo, mrb);
+        },
+        MRB_ARGS_NONE());
+
+    // Seconds of audio mixed so far; not affected by the tempo
+    mrb_define_method(
+        ruby, RAudio::rclass, "time",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            return mrb::to_value(
+                static_cast<double>(audio->sample_time) / 44100.0, mrb);
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, RAudio::rclass, "beat",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            return mrb::to_value(mrb::self_to<RAudio>(self)->get_beat(), mrb);
+        },
+        MRB_ARGS_NONE());
+
+    // schedule(beat, [channel,] sound_or_synth, freq, velocity = 1,
+    //     length = 1)
+    // Start a note at the given beat. Synth notes are released `length`
+    // beats later. Without a channel, a voice is allocated and returned.
+    mrb_define_method(
+        ruby, RAudio::rclass, "schedule",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            bool explicit_channel = int_arg(mrb, 1);
+            mrb_float beat = 0;
+            mrb_int chan = -1;
+            mrb_value obj{};
+            mrb_float freq = 0;
+            mrb_float velocity = 1.0;
+            mrb_float length = 1.0;
+            if (explicit_channel) {
+                mrb_get_args(mrb, "fiof|ff", &beat, &chan, &obj, &freq,
+                    &velocity, &length);
+            } else {
+                mrb_get_args(
+                    mrb, "fof|ff", &beat, &obj, &freq, &velocity, &length);
+            }
+            auto start = audio->beat_to_time(beat);
+            auto f = static_cast<float>(freq);
+            auto vel = static_cast<float>(velocity);
+            Voice voice;
+            if (auto* sound = static_cast<Sound*>(
+                    mrb_data_check_get_ptr(mrb, obj, &Sound::dt))) {
+                if (explicit_channel) {
+                    audio->set_sound(chan, *sound, f, false, vel, start);
+                } else {
+                    voice = audio->play_sound(*sound, f, vel, start);
+                }
+            } else {
+                auto* synth = static_cast<Synth*>(
+                    mrb_data_get_ptr(mrb, obj, &Synth::dt));
+                uint32_t id = 0;
+                if (explicit_channel) {
+                    id = audio->note_on(chan, synth->patch, f, vel, start);
+                } else {
+                    voice = audio->play_note(*synth, f, vel, start);
+                    chan = voice.channels[0];
+                    id = voice.ids[0];
+                }
+                if (length > 0 && chan >= 0) {
+                    audio->note_off(
+                        chan, audio->beat_to_time(beat + length), id);
+                }
+            }
+            return explicit_channel ? self : voice_value(mrb, voice);
+        },
+        MRB_ARGS_REQ(4) | MRB_ARGS_OPT(2));
+
+    mrb_define_method(
+        ruby, RAudio::rclass, "stats",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            auto& stats = audio->stats;
+            auto hash = mrb_hash_new(mrb);
+            auto set = [&](char const* name, int value) {
+                mrb_hash_set(mrb, hash,
+                    mrb_symbol_value(mrb_intern_cstr(mrb, name)),
+                    mrb::to_value(value, mrb));
+            };
+            set("underruns", audio->system.audio_underruns());
+            set("late", stats.late);
+            set("mix_time", stats.mix_time);
+            set("max_mix_time", stats.max_mix_time);
+            set("fill", stats.fill);
+            set("period", stats.period);
+            set("deferred", stats.deferred);
+            return hash;
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, rclass, "set_volume",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [chan, vol] = mrb::get_args<int, float>(mrb);
+            mrb::self_to<RAudio>(self)->set_volume(chan, vol);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(2));
+
+    mrb_define_method(
+        ruby, rclass, "set_pan",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [chan, pan] = mrb::get_args<int, float>(mrb);
+            mrb::self_to<RAudio>(self)->set_pan(chan, pan);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(2));
+
+    // Master bus. Each method changes one effect and sends the complete
+    // settings to the audio thread.
+
+    mrb_define_method(
+        ruby, rclass, "volume=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [vol] = mrb::get_args<float>(mrb);
+            auto* audio = mrb::self_to<RAudio>(self);
+            auto params = audio->bus_params;
+            params.volume = std::max(vol, 0.0F);
+            audio->set_bus(params);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    // delay(seconds, feedback = 0.4, mix = 0.3); 0 seconds turns it off
+    mrb_define_method(
+        ruby, rclass, "delay",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            auto params = audio->bus_params;
+            mrb_float time = 0;
+            mrb_float feedback = params.delay_feedback;
+            mrb_float mix = params.delay_mix;
+            mrb_get_args(mrb, "f|ff", &time, &feedback, &mix);
+            params.delay_time = static_cast<float>(std::clamp(time, 0.0, 1.9));
+            params.delay_feedback =
+                static_cast<float>(std::clamp(feedback, 0.0, 0.95));
+            params.delay_mix = static_cast<float>(mix);
+            audio->set_bus(params);
+            return self;
+        },
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
+
+    // reverb(mix, room = 0.5); 0 mix turns it off
+    mrb_define_method(
+        ruby, rclass, "reverb",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            auto params = audio->bus_params;
+            mrb_float mix = 0;
+            mrb_float room = params.reverb_room;
+            mrb_get_args(mrb, "f|f", &mix, &room);
+            params.reverb_mix = static_cast<float>(std::max(mix, 0.0));
+            params.reverb_room = static_cast<float>(room);
+            audio->set_bus(params);
+            return self;
+        },
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+
+    // master_filter(:low | :high | :none, cutoff = 2000)
+    mrb_define_method(
+        ruby, rclass, "master_filter",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* audio = mrb::self_to<RAudio>(self);
+            auto params = audio->bus_params;
+            mrb_sym type{};
+            mrb_float cutoff = params.filter_cutoff;
+            mrb_get_args(mrb, "n|f", &type, &cutoff);
+            auto filter = to_filter(mrb, type);
+            if (filter == FilterType::BandPass) {
+                mrb_raise(mrb, E_ARGUMENT_ERROR, "Master filter is :low or :high");
+            }
+            params.filter = filter == FilterType::LowPass    ? 1
+                            : filter == FilterType::HighPass ? 2
+                                                             : 0;
+            params.filter_cutoff = static_cast<float>(cutoff);
+            audio->set_bus(params);
+            return self;
+        },
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+
+    mrb_define_method(
+        ruby, rclass, "limiter=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [on] = mrb::get_args<bool>(mrb);
+            auto* audio = mrb::self_to<RAudio>(self);
+            auto params = audio->bus_params;
+            params.limiter = on;
+            audio->set_bus(params);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Sound::rclass, "priority=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [p] = mrb::get_args<int>(mrb);
+            mrb::self_to<Sound>(self)->priority = p;
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Sound::rclass, "max_voices=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [n] = mrb::get_args<int>(mrb);
+            mrb::self_to<Sound>(self)->max_voices = n;
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "priority=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [p] = mrb::get_args<int>(mrb);
+            mrb::self_to<Synth>(self)->priority = p;
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Synth::rclass, "max_voices=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [n] = mrb::get_args<int>(mrb);
+            mrb::self_to<Synth>(self)->max_voices = n;
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    // Voice methods only affect channels the voice still owns
+
+    mrb_define_method(
+        ruby, Voice::rclass, "playing?",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* voice = mrb::self_to<Voice>(self);
+            auto* audio = default_audio;
+            bool playing = false;
+            for (int i = 0; i < 2; i++) {
+                auto c = voice->channels[i];
+                if (audio->owns(c, voice->ids[i]) && audio->busy(c)) {
+                    playing = true;
+                }
+            }
+            return mrb::to_value(playing, mrb);
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, Voice::rclass, "stop",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* voice = mrb::self_to<Voice>(self);
+            for (int i = 0; i < 2; i++) {
+                if (default_audio->owns(voice->channels[i], voice->ids[i])) {
+                    default_audio->stop(voice->channels[i]);
+                }
+            }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, Voice::rclass, "note_off",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* voice = mrb::self_to<Voice>(self);
+            if (default_audio->owns(voice->channels[0], voice->ids[0])) {
+                default_audio->note_off(voice->channels[0]);
+            }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, Voice::rclass, "freq=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [hz] = mrb::get_args<int>(mrb);
+            auto* voice = mrb::self_to<Voice>(self);
+            for (int i = 0; i < 2; i++) {
+                if (default_audio->owns(voice->channels[i], voice->ids[i])) {
+                    default_audio->set_frequency(voice->channels[i], hz);
+                }
+            }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Voice::rclass, "volume=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [vol] = mrb::get_args<float>(mrb);
+            auto* voice = mrb::self_to<Voice>(self);
+            for (int i = 0; i < 2; i++) {
+                if (default_audio->owns(voice->channels[i], voice->ids[i])) {
+                    default_audio->set_volume(voice->channels[i], vol);
+                }
+            }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Voice::rclass, "pan=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [pan] = mrb::get_args<float>(mrb);
+            auto* voice = mrb::self_to<Voice>(self);
+            for (int i = 0; i < 2; i++) {
+                if (default_audio->owns(voice->channels[i], voice->ids[i])) {
+                    default_audio->set_pan(voice->channels[i], pan);
+                }
+            }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, Stream::rclass, "done?",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* stream = mrb::self_to<Stream>(self);
+            return mrb::to_value(stream->stream->finished(0), mrb);
+        },
+        MRB_ARGS_NONE());
+
     mrb_define_method(
         ruby, RAudio::rclass, "play",
         [](mrb_state* mrb, mrb_value self) -> mrb_value {
             auto* audio = mrb::self_to<RAudio>(self);
-            Sound* sound{};
+            mrb_value obj{};
             mrb_float freq = 0;
             mrb_int chan = 0;
-            auto n = mrb_get_argc(mrb);
-            if (n == 3) {
-                mrb_get_args(mrb, "idf", &chan, &sound, &Sound::dt, &freq);
-            } else if (n == 2) {
-                mrb_get_args(mrb, "id", &chan, &sound, &Sound::dt);
-            } else if (n == 1) {
-                mrb_get_args(mrb, "d", &sound, &Sound::dt);
-                chan = audio->next_channel;
-                audio->next_channel = (audio->next_channel + 2) % 32;
-            }
-            fmt::print("chan {}, freq {}\n", chan, freq);
-            audio->set_sound(chan, *sound, static_cast<float>(freq));
+            if (!int_arg(mrb, 0)) {
+                // play(sound_or_stream [, freq]) allocates a voice
+                mrb_get_args(mrb, "o|f", &obj, &freq);
+                if (auto* sound = static_cast<Sound*>(
+                        mrb_data_check_get_ptr(mrb, obj, &Sound::dt))) {
+                    return voice_value(mrb,
+                        audio->play_sound(*sound, static_cast<float>(freq)));
+                }
+                auto* stream = static_cast<Stream*>(
+                    mrb_data_get_ptr(mrb, obj, &Stream::dt));
+                return voice_value(mrb, audio->play_stream(stream->stream));
+            }
+            mrb_get_args(mrb, "io|f", &chan, &obj, &freq);
+            if (auto* sound = static_cast<Sound*>(
+                    mrb_data_check_get_ptr(mrb, obj, &Sound::dt))) {
+                audio->set_sound(chan, *sound, static_cast<float>(freq));
+            } else {
+                auto* stream = static_cast<Stream*>(
+                    mrb_data_get_ptr(mrb, obj, &Stream::dt));
+                audio->set_stream(chan, stream->stream);
+            }
             return self;
         },
-        MRB_ARGS_REQ(2));
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(2));
 
     mrb_define_class_method(
         ruby, rclass, "default",
@@ -135,59 +1236,120 @@ void RAudio::reg_class(
         [](mrb_state* mrb, mrb_value self) -> mrb_value {
             auto [chan, freq] = mrb::get_args<int, int>(mrb);
             auto* audio = mrb::self_to<RAudio>(self);
-            audio->channels[chan].step = static_cast<float>(freq) / 44100.F;
+            audio->set_frequency(chan, freq);
             return mrb_nil_value();
         },
         MRB_ARGS_REQ(2));
 
+    mrb_define_method(
+        ruby, rclass, "stop",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [chan] = mrb::get_args<int>(mrb);
+            auto* audio = mrb::self_to<RAudio>(self);
+            audio->stop(chan);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    // load_wav(file_name, float = false)
+    // 8 and 16 bit PCM files are kept in their own format unless float
+    // is requested
     mrb_define_class_method(
         ruby, RAudio::rclass, "load_wav",
         [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
-            auto [fname] = mrb::get_args<std::string>(mrb);
-            unsigned channel_count = 0;
-            unsigned freq = 0;
-            drwav_uint64 frames = 0;
-            float* sample_data = drwav_open_file_and_read_pcm_frames_f32(
-                fname.c_str(), &channel_count, &freq, &frames, nullptr);
-            if (sample_data == nullptr) {
-                // Error opening and reading WAV file.
+            char const* fname = nullptr;
+            mrb_bool as_float = FALSE;
+            mrb_get_args(mrb, "z|b", &fname, &as_float);
+            drwav wav{};
+            if (drwav_init_file(&wav, fname, nullptr) == DRWAV_FALSE) {
+                // Error opening WAV file.
                 return mrb_nil_value();
             }
-            fmt::print("Channels {}, freq {} frames {}\n", channel_count, freq,
-                frames);
+            auto frames = static_cast<size_t>(wav.totalPCMFrameCount);
+            auto channel_count = static_cast<unsigned>(wav.channels);
+            fmt::print("Channels {}, freq {} frames {} bits {}\n",
+                channel_count, wav.sampleRate, frames, wav.bitsPerSample);
 
             auto* sound = new Sound();
-            sound->freq = static_cast<float>(freq);
+            sound->freq = static_cast<float>(wav.sampleRate);
             sound->channels = channel_count;
-            sound->data.resize(frames * channel_count);
-            for (size_t i = 0; i < frames; i++) {
-                for (size_t j = 0; j < channel_count; j++) {
-                    sound->data[j * frames + i] = sample_data[i * 2 + j];
-                }
+            auto size = frames * channel_count;
+            bool pcm = wav.translatedFormatTag == DR_WAVE_FORMAT_PCM;
+            if (!as_float && pcm && wav.bitsPerSample == 16) {
+                std::vector<int16_t> data(size);
+                frames = drwav_read_pcm_frames_s16(&wav, frames, data.data());
+                sound->set_data(deinterleave(data, channel_count, frames));
+            } else if (!as_float && pcm && wav.bitsPerSample == 8) {
+                // Raw 8 bit PCM is already unsigned bytes
+                std::vector<uint8_t> data(size);
+                frames = drwav_read_pcm_frames(&wav, frames, data.data());
+                sound->set_data(deinterleave(data, channel_count, frames));
+            } else {
+                std::vector<float> data(size);
+                frames = drwav_read_pcm_frames_f32(&wav, frames, data.data());
+                sound->set_data(deinterleave(data, channel_count, frames));
             }
-            drwav_free(sample_data, nullptr);
+            drwav_uninit(&wav);
             return mrb::new_data_obj(mrb, sound);
         },
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
+
+    mrb_define_class_method(
+        ruby, RAudio::rclass, "load_music",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            auto [fname] = mrb::get_args<std::string>(mrb);
+            auto mod = ModData::load(fname);
+            if (mod == nullptr) { return mrb_nil_value(); }
+            return mrb::new_data_obj(mrb, new Tracker{mod});
+        },
         MRB_ARGS_REQ(1));
-}
 
-#ifdef MUSIC
-RAUdio::play_music(std::string const& name)
-{
-    using namespace musix;
+    mrb_define_method(
+        ruby, Tracker::rclass, "title",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            return mrb::to_value(mrb::self_to<Tracker>(self)->mod->title, mrb);
+        },
+        MRB_ARGS_NONE());
 
-    ChipPlugin::createPlugins("data");
+    mrb_define_method(
+        ruby, Tracker::rclass, "channels",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            return mrb::to_value(
+                mrb::self_to<Tracker>(self)->mod->channels, mrb);
+        },
+        MRB_ARGS_NONE());
 
-    std::shared_ptr<ChipPlayer> player;
+    // play_music(tracker, loop = true)
+    mrb_define_method(
+        ruby, rclass, "play_music",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            Tracker* tracker{};
+            mrb_bool loop = TRUE;
+            mrb_get_args(mrb, "d|b", &tracker, &Tracker::dt, &loop);
+            mrb::self_to<RAudio>(self)->play_music(tracker->mod, loop);
+            return self;
+        },
+        MRB_ARGS_REQ(1) | MRB_ARGS_OPT(1));
 
-    for (const auto& plugin : ChipPlugin::getPlugins()) {
-        if (plugin->canHandle(name)) {
-            if (auto* ptr = plugin->fromFile(name)) {
-                player = std::shared_ptr<ChipPlayer>(ptr);
-                pluginName = plugin->name();
-                break;
-            }
-        }
-    }
+    mrb_define_method(
+        ruby, rclass, "stop_music",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            mrb::self_to<RAudio>(self)->stop_music();
+            return self;
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_class_method(
+        ruby, RAudio::rclass, "stream",
+        [](mrb_state* mrb, mrb_value /*self*/) -> mrb_value {
+            auto [fname] = mrb::get_args<std::string>(mrb);
+            auto stream = std::make_shared<WavStream>(fname);
+            if (!stream->is_open()) { return mrb_nil_value(); }
+            // Decode the first part right away so playback can start
+            // before the decoder thread gets to it
+            stream->fill();
+            default_audio->add_stream(stream);
+            return mrb::new_data_obj(mrb, new Stream{stream});
+        },
+        MRB_ARGS_REQ(1));
 }
-#endif
@@ -4,18 +4,96 @@
 #include "settings.hpp"
 #include "mrb_tools.hpp"
 #include "ring_buffer.hpp"
+#include "audio_stream.hpp"
+#include "synth.hpp"
+#include "samples.hpp"
+#include "audio_effects.hpp"
+#include "mod_player.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <variant>
+#include <vector>
 
 struct Sound
 {
-    std::vector<float> data;
-    float const* channel(int n) const
+    using Samples = SampleData;
+
+    // Sample data is never changed once created. It is shared between
+    // the ruby object and all channels currently playing it.
+    std::shared_ptr<Samples const> data;
+
+    template <typename T>
+    void set_data(std::vector<T>&& samples)
+    {
+        data = std::make_shared<Samples const>(std::move(samples));
+    }
+
+    bool empty() const { return data == nullptr || size() == 0; }
+
+    size_t size() const
     {
-        size_t sz = data.size() / channels;
-        return &data[n * sz];
+        return std::visit([](auto const& v) { return v.size(); }, *data);
     }
-    size_t frames() const { return data.size() / channels; }
+
+    SampleFormat format() const
+    {
+        return static_cast<SampleFormat>(data->index());
+    }
+
+    void const* channel(int n) const
+    {
+        return std::visit(
+            [&](auto const& v) -> void const* {
+                return v.data() + n * frames();
+            },
+            *data);
+    }
+    size_t frames() const { return data ? size() / channels : 0; }
     float freq = 0;
     unsigned channels = 1;
+    // Voice allocation; higher priority voices are never stolen by lower,
+    // and at most `max_voices` (if > 0) can play this sound at once
+    int priority = 0;
+    int max_voices = 0;
+    static inline RClass* rclass;
+    static mrb_data_type dt;
+};
+
+// Ruby handle to an AudioStream
+struct Stream
+{
+    std::shared_ptr<AudioStream> stream;
+    static inline RClass* rclass;
+    static mrb_data_type dt;
+};
+
+// Ruby handle to a loaded tracker module
+struct Tracker
+{
+    std::shared_ptr<ModData const> mod;
+    static inline RClass* rclass;
+    static mrb_data_type dt;
+};
+
+// Ruby handle to a synth patch
+struct Synth
+{
+    Patch patch;
+    int priority = 0;
+    int max_voices = 0;
+    static inline RClass* rclass;
+    static mrb_data_type dt;
+};
+
+// Ruby handle to the channels an allocated sound or note plays on.
+// Does nothing once the voice has been stolen.
+struct Voice
+{
+    std::array<int, 2> channels{-1, -1};
+    std::array<uint32_t, 2> ids{};
     static inline RClass* rclass;
     static mrb_data_type dt;
 };
@@ -24,49 +102,351 @@ class RAudio
 {
     struct Channel
     {
-        std::vector<float> data;
+        // Keeps the samples alive while playing
+        std::shared_ptr<Sound::Samples const> buffer;
+        void const* data = nullptr;
+        SampleFormat format = SampleFormat::Float;
+        size_t size = 0;
+        // Set if we are playing a stream instead
+        std::shared_ptr<AudioStream> stream;
+        int plane = 0;
+        float last = 0;
+        // Used instead of sample data if active
+        SynthVoice synth;
+        // Voice that last started here, so late commands for a stolen
+        // voice can be ignored
+        uint32_t id = 0;
         bool loop = false;
         float pos = 0;
         float step = 0.0F;
+        float gain = 1.0F;
+
+        // Set from ruby. Stereo sounds are spread so their left plane is
+        // panned one step to the left and the right plane to the right.
+        float volume = 1.0F;
+        float pan = 0.0F;
+        float spread = 0.0F;
+        float left_gain = 0.0F;
+        float right_gain = 0.0F;
 
         static constexpr float ds = 30000;
         static constexpr float dl = 20000;
 
-        void set(float freq, float const* ptr, size_t size)
+        bool active() const { return step != 0 || synth.active(); }
+
+        // Equal power panning
+        void update_gains()
         {
-            data.resize(size);
-            std::copy(ptr, ptr + size, data.begin());
-            // loop = loop;
-            pos = 0;
-            step = freq / 44100.F;
+            auto p = std::clamp(pan + spread, -1.0F, 1.0F);
+            auto a = (p + 1.0F) * 0.25F * 3.14159265F;
+            left_gain = std::cos(a) * volume;
+            right_gain = std::sin(a) * volume;
         }
-        float read()
+
+        Channel() { update_gains(); }
+
+        static float damp_at(float p)
         {
-            if (step == 0) { return 0; }
+            return std::clamp(1.0F - (p - ds) / dl, 0.0F, 1.0F);
+        }
 
-            auto sz = static_cast<float>(data.size());
+        // Fill `out` with the next `n` samples
+        void read_block(float* out, size_t n)
+        {
+            if (synth.active()) {
+                for (size_t i = 0; i < n; i++) {
+                    out[i] = synth.read();
+                }
+                return;
+            }
+            if (step != 0 && stream) {
+                for (size_t i = 0; i < n; i++) {
+                    out[i] = read_stream();
+                }
+                return;
+            }
+            if (step == 0 || data == nullptr) {
+                std::fill(out, out + n, 0.0F);
+                return;
+            }
+            switch (format) {
+            case SampleFormat::Float:
+                read_samples(static_cast<float const*>(data), out, n);
+                break;
+            case SampleFormat::Int16:
+                read_samples(static_cast<int16_t const*>(data), out, n);
+                break;
+            case SampleFormat::UInt8:
+                read_samples(static_cast<uint8_t const*>(data), out, n);
+                break;
+            }
+            for (size_t i = 0; i < n; i++) {
+                out[i] *= gain;
+            }
+        }
 
-            auto ip = static_cast<size_t>(pos);
-            auto f = data[ip];
-            pos += step;
-            float damp = std::clamp(1.0F - (pos - ds) / dl, 0.0F, 1.0F);
+        template <typename T>
+        void read_samples(T const* src, float* out, size_t n)
+        {
+            auto sz = static_cast<float>(size);
+            size_t i = 0;
+            while (i < n && step != 0) {
+                auto start = i;
+                if (step == 1.0F && pos == std::floor(pos)) {
+                    // Playing at the native rate; convert a contiguous run
+                    auto ip = static_cast<size_t>(pos);
+                    auto count = std::min(n - i, size - ip);
+                    convert(src + ip, out + i, count);
+                    i += count;
+                    pos += static_cast<float>(count);
+                } else {
+                    while (i < n && pos < sz) {
+                        out[i++] = to_float(src[static_cast<size_t>(pos)]);
+                        pos += step;
+                    }
+                }
+                // Fade out long samples
+                if (pos > ds) {
+                    auto p = pos;
+                    for (auto j = i; j > start; j--) {
+                        out[j - 1] *= damp_at(p);
+                        p -= step;
+                    }
+                }
+                if (pos >= sz) {
+                    pos -= sz;
+                    if (!loop) { step = 0; }
+                }
+            }
+            std::fill(out + i, out + n, 0.0F);
+        }
 
-            if (pos > sz) {
-                pos -= sz;
-                if (!loop) { step = 0; }
+        float read_stream()
+        {
+            auto& ring = stream->rings[plane];
+            pos += step;
+            while (pos >= 1.0F) {
+                if (ring.read(&last, 1) == 0) {
+                    // Ring is empty; either we are done or the decoder
+                    // has fallen behind
+                    if (stream->finished(plane)) { step = 0; }
+                    pos = 0;
+                    return 0;
+                }
+                pos -= 1.0F;
             }
-            // float a = pos - (float)ip;
-            // f = sound.data[ip] * (1-a) + sound.data[ip+1] * a;
-            return f * damp;
+            return last;
+        }
+    };
+
+    // Commands are created in the main thread and executed by the
+    // audio thread before mixing the next block.
+    struct PlayCmd
+    {
+        int channel;
+        uint32_t id;
+        std::shared_ptr<Sound::Samples const> buffer;
+        void const* data;
+        SampleFormat format;
+        size_t size;
+        float step;
+        bool loop;
+        float gain;
+        float spread;
+    };
+
+    struct StreamCmd
+    {
+        int channel;
+        uint32_t id;
+        std::shared_ptr<AudioStream> stream;
+        int plane;
+        float step;
+        float spread;
+    };
+
+    struct FreqCmd
+    {
+        int channel;
+        float step;
+    };
+
+    struct StopCmd
+    {
+        int channel;
+    };
+
+    struct NoteOnCmd
+    {
+        int channel;
+        uint32_t id;
+        Patch patch;
+        float freq;
+        float velocity;
+    };
+
+    // Ignored if `id` is set and another voice has started since
+    struct NoteOffCmd
+    {
+        int channel;
+        uint32_t id;
+    };
+
+    struct VolumeCmd
+    {
+        int channel;
+        float volume;
+    };
+
+    struct PanCmd
+    {
+        int channel;
+        float pan;
+    };
+
+    struct BusCmd
+    {
+        BusParams params;
+    };
+
+    // Start playing a module, or stop if player is null
+    struct MusicCmd
+    {
+        std::shared_ptr<ModPlayer> player;
+    };
+
+    using Command = std::variant<std::monostate, PlayCmd, StreamCmd, FreqCmd,
+        StopCmd, NoteOnCmd, NoteOffCmd, VolumeCmd, PanCmd, BusCmd, MusicCmd>;
+
+    // A command that should be executed at a specific time, counted in
+    // samples mixed since start. 0 means as soon as possible.
+    struct Message
+    {
+        uint64_t time;
+        Command cmd;
+    };
+
+    // Sequenced message waiting in the audio thread
+    struct Pending
+    {
+        uint64_t time;
+        uint64_t order;
+        Command cmd;
+        bool operator<(Pending const& other) const
+        {
+            // Min heap; messages with the same time are applied in the
+            // order they were sent
+            return time != other.time ? time > other.time
+                                      : order > other.order;
         }
     };
 
+    static constexpr size_t min_block = 64;
+    static constexpr size_t max_block = 4096;
+    static constexpr size_t max_pending = 1024;
+
+    // Written by the audio thread, read by ruby
+    struct Stats
+    {
+        // Callbacks that took longer than the audio they delivered
+        std::atomic<int> late{0};
+        // Time to mix one block, in microseconds
+        std::atomic<int> mix_time{0};
+        std::atomic<int> max_mix_time{0};
+        // Frames left over in `out_buffer` after the last callback
+        std::atomic<int> fill{0};
+        // Frames requested by the device per callback
+        std::atomic<int> period{0};
+        // Blocks where sequenced commands had to wait for room in the heap
+        std::atomic<int> deferred{0};
+    };
+
     mrb::RubyPtr audio_handler;
     //mrb_state* ruby;
     System& system;
+
+    // Only touched by the audio thread
     Ring<float, 16384> out_buffer;
+    // Mix this many frames at a time. Follows the device period so we
+    // don't mix further ahead than needed.
+    size_t block_size = 512;
     std::array<Channel, 32> channels;
-    int next_channel = 0;
+    // Master bus, applied to the mixed block
+    EffectBus bus;
+    // Module currently playing
+    std::shared_ptr<ModPlayer> music;
+
+    // Heap of sequenced commands, capacity is reserved up front so pushing
+    // never allocates
+    std::vector<Pending> pending;
+    uint64_t pending_order = 0;
+    // First command that did not fit in `pending`. It, and everything
+    // after it, waits in the queue until the heap has room.
+    std::optional<Message> held;
+
+    // Samples mixed so far. Written by the audio thread only.
+    std::atomic<uint64_t> sample_time{0};
+
+    // main -> audio
+    Queue<Message, 1024> commands;
+    // audio -> main; Samples and streams no longer used by a channel.
+    // Dropping the last reference must not happen in the audio thread.
+    Queue<std::shared_ptr<void const>, 256> retired;
+
+    StreamDecoder decoder;
+
+    Stats stats;
+
+    // Voice allocation, main thread only
+    struct VoiceState
+    {
+        // Changes every time the channel is claimed; 0 if never used
+        uint32_t id = 0;
+        int priority = 0;
+        // Sound data or synth, for polyphony limits
+        void const* group = nullptr;
+        // When the voice was claimed, or when it is scheduled to start
+        uint64_t start = 0;
+        // When it is known to be done; sounds end after their last
+        // frame, and notes `release` samples after their note off
+        uint64_t end = UINT64_MAX;
+        uint64_t release = 0;
+    };
+    std::array<VoiceState, 32> voices;
+    uint32_t next_voice_id = 1;
+
+    // Peak level of each channel in the last block, 0 if it is not
+    // playing. Written by the audio thread.
+    std::array<std::atomic<float>, 32> levels{};
+
+    // Last bus settings sent to the audio thread, main thread only
+    BusParams bus_params;
+
+    // Sequencer clock, main thread only
+    double tempo = 120;
+    double beat_origin = 0;
+
+    void send(Command&& cmd, uint64_t time = 0);
+    void apply(std::monostate&) {}
+    void apply(PlayCmd& cmd);
+    void apply(StreamCmd& cmd);
+    void apply(FreqCmd& cmd);
+    void apply(StopCmd& cmd);
+    void apply(NoteOnCmd& cmd);
+    void apply(NoteOffCmd& cmd);
+    void apply(VolumeCmd& cmd);
+    void apply(PanCmd& cmd);
+    void apply(BusCmd& cmd);
+    void apply(MusicCmd& cmd);
+    void audio_callback(float* data, size_t size);
+    bool take(Message& msg);
+    void apply_commands();
+    void apply_pending(uint64_t until);
+    void retire(Channel& chan);
+    void drop_voice(uint32_t id, std::vector<int>& freed);
+    int steal(int priority, uint64_t time, uint32_t id) const;
+    void retire_music();
+    void mix_channels(float* left, float* right, size_t start, size_t end);
     void mix(size_t samples_len);
 
 public:
@@ -74,9 +454,51 @@ public:
     static inline RClass* rclass;
     static inline mrb_data_type dt{"Audio", [](mrb_state*, void* data) {}};
 
-    void set_sound(
-        int channel, Sound const& sound, float freq = 0, bool loop = false);
+    void set_sound(int channel, Sound const& sound, float freq = 0,
+        bool loop = false, float velocity = 1.0F, uint64_t time = 0);
+    void set_stream(int channel, std::shared_ptr<AudioStream> const& stream);
+    // Let the decoder thread keep `stream` filled
+    void add_stream(std::shared_ptr<AudioStream> const& stream);
+
+    // Mark channel as used by voice `id`, or by a new voice if 0, and
+    // return the id
+    uint32_t claim(int channel, int priority = 0, void const* group = nullptr,
+        uint64_t time = 0, uint32_t id = 0);
+    // Find free channels for the `planes` of one voice, stealing from the
+    // least important voices if needed. `max_voices` counts voices, not
+    // channels. Returns a voice without channels if all channels play
+    // voices of higher priority.
+    Voice allocate(int priority = 0, void const* group = nullptr,
+        int max_voices = 0, uint64_t time = 0, unsigned planes = 1);
+    bool owns(int channel, uint32_t id) const;
+    // Is the channel in use at `time`, or now if 0
+    bool busy(int channel, uint64_t time = 0) const;
+
+    // Allocate channels and play. Returns a voice without channels if
+    // none could be allocated.
+    Voice play_sound(Sound const& sound, float freq = 0,
+        float velocity = 1.0F, uint64_t time = 0);
+    Voice play_stream(std::shared_ptr<AudioStream> const& stream);
+    Voice play_note(Synth const& synth, float freq, float velocity = 1.0F,
+        uint64_t time = 0);
     void set_frequency(int channel, int hz);
+    void stop(int channel);
+    // Returns the id of the note, for `note_off`
+    uint32_t note_on(int channel, Patch const& patch, float freq,
+        float velocity, uint64_t time = 0);
+    // With an `id`, only releases the note if that voice still plays it
+    void note_off(int channel, uint64_t time = 0, uint32_t id = 0);
+    void set_volume(int channel, float volume);
+    // -1 is left, 1 is right
+    void set_pan(int channel, float pan);
+    void set_bus(BusParams const& params);
+    void play_music(std::shared_ptr<ModData const> const& mod, bool loop);
+    void stop_music();
+
+    // Sequencer time is counted in beats at the current tempo
+    void set_tempo(double bpm);
+    double get_beat() const;
+    uint64_t beat_to_time(double beat) const;
 
     void update();
 
@@ -38,20 +38,22 @@ pix::Image RCanvas::read_image(int x, int y, int w, int h)
 void RCanvas::draw_quad(
     double x, double y, double w, double h, RStyle const* style)
 {
+    dirty = true;
     if (style == nullptr) { style = &current_style; }
     canvas->set_target();
     gl::ProgramCache::get_instance().textured.use();
     pix::set_colors(style->fg, style->bg);
-    if (style->blend_mode == BlendMode::Add) { glBlendFunc(GL_ONE, GL_ONE); }
+    if (style->blend_mode == BlendMode::Add) { gl::blendFunc(GL_ONE, GL_ONE); }
     pix::draw_quad_filled(x, y, w, h);
     if (style->blend_mode == BlendMode::Add) {
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
 }
 
 void RCanvas::draw_line(
     double x0, double y0, double x1, double y1, RStyle const* style)
 {
+    dirty = true;
     if (style == nullptr) { style = &current_style; }
     canvas->set_target();
     glLineWidth(style->line_width);
@@ -61,23 +63,25 @@ void RCanvas::draw_line(
 
 void RCanvas::draw_circle(double x, double y, double r, RStyle const* style)
 {
+    dirty = true;
     if (style == nullptr) { style = &current_style; }
     canvas->set_target();
     glLineWidth(style->line_width);
     pix::set_colors(style->fg, style->bg);
-    if (style->blend_mode == BlendMode::Add) { glBlendFunc(GL_ONE, GL_ONE); }
+    if (style->blend_mode == BlendMode::Add) { gl::blendFunc(GL_ONE, GL_ONE); }
     pix::draw_circle({x, y}, r);
     if (style->blend_mode == BlendMode::Add) {
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+        gl::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     }
 }
 
 void RCanvas::clear()
 {
+    dirty = true;
     canvas->set_target();
     gl::clearColor({0});
     glClear(GL_COLOR_BUFFER_BIT);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    gl::bindFramebuffer(0);
 }
 
 void RCanvas::reset()
@@ -89,6 +93,7 @@ void RCanvas::reset()
 void RCanvas::draw_image(
     double x, double y, RImage* image, double scale, RStyle const* style)
 {
+    dirty = true;
     if (style == nullptr) { style = &current_style; }
     canvas->set_target();
     glLineWidth(current_style.line_width);
@@ -41,6 +41,7 @@ public:
     RCanvas(int w, int h);
     void render() override;
     void reset() override;
+    char const* name() const override { return "canvas"; }
 
     static void reg_class(mrb_state* ruby);
 };
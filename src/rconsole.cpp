@@ -89,6 +89,17 @@ void RConsole::render()
     console->render();
 }
 
+bool RConsole::is_dirty() const
+{
+    return dirty || console->changes() != rendered;
+}
+
+void RConsole::mark_clean()
+{
+    RLayer::mark_clean();
+    rendered = console->changes();
+}
+
 uint32_t RConsole::get(int x, int y) const
 {
     return console->get_char(x, y);
@@ -32,6 +32,8 @@ class RConsole : public RLayer
     uint32_t get(int x, int y) const;
     std::array<float, 4> default_fg;
     std::array<float, 4> default_bg;
+    // Console contents at the last render
+    uint32_t rendered = ~0U;
 public:
     void text(int x, int y, std::string const& t, RStyle const* style = nullptr);
     void fill(uint32_t fg, uint32_t bg);
@@ -46,6 +48,10 @@ public:
     void render() override;
     void update_tx() override;
 
+    char const* name() const override { return "console"; }
+    bool is_dirty() const override;
+    void mark_clean() override;
+
     static inline RClass* rclass = nullptr;
     static inline mrb_data_type dt{"Console",
         [](mrb_state*,
@@ -7,13 +7,18 @@
 #include "rsprites.hpp"
 
 #include "error.hpp"
+#include "frame_timer.hpp"
 #include "gl/functions.hpp"
+#include "gl/program_cache.hpp"
 #include "mrb_tools.hpp"
 
 #include <glm/ext.hpp>
 #include <glm/glm.hpp>
+#include <mruby/array.h>
 #include <mruby/compile.h>
 #include <pix/pix.hpp>
+
+#include <algorithm>
 #ifdef __APPLE__
 #    include "TargetConditionals.h"
 #    if TARGET_OS_OSX
@@ -29,6 +34,27 @@ mrb_data_type Display::dt{"Display", [](mrb_state*, void* data) {
                               }
                           }};
 
+// Dropping the last ruby handle to a layer made by ruby frees it, unless
+// it is in the stack. Not right away, since destroying a layer unregisters
+// ruby objects, which must not happen during a GC sweep.
+void Display::free_handle(mrb_state* /*mrb*/, void* data)
+{
+    auto& display = *Display::default_display;
+    auto it = display.handles.find(data);
+    if (it == display.handles.end() || --it->second.count > 0) { return; }
+    display.released.push_back(std::move(it->second.layer));
+    display.handles.erase(it);
+}
+
+void Display::release_layers()
+{
+    handles.clear();
+    default_layers();
+    released.clear();
+}
+
+mrb_data_type Display::handle_dt{"Layer", Display::free_handle};
+
 Display::Display(mrb_state* state, System& system, Settings const& _settings)
     : RLayer(0, 0), ruby(state), settings{_settings}
 {
@@ -56,12 +82,10 @@ void Display::setup()
     canvas = std::make_shared<RCanvas>(w, h);
     canvas->init(ruby);
     sprites = std::make_shared<RSprites>(w, h);
+    default_layers();
     glEnable(GL_BLEND);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    // GLuint vao;
-    // glGenVertexArrays(1, &vao);
-    // glBindVertexArray(vao);
+    gl::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+    gl::bindFramebuffer(0);
 }
 
 bool Display::begin_draw()
@@ -71,16 +95,125 @@ bool Display::begin_draw()
     return false;
 }
 
-void Display::end_draw()
+void Display::default_layers()
 {
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    gl::clearColor({bg});
-    glClear(GL_COLOR_BUFFER_BIT);
+    layers = {console, canvas, sprites};
+    stack_changed();
+}
+
+void Display::insert_layer(std::shared_ptr<RLayer> const& layer, int index)
+{
+    auto it = std::find(layers.begin(), layers.end(), layer);
+    if (it != layers.end()) { layers.erase(it); }
+    if (index < 0 || index > static_cast<int>(layers.size())) {
+        index = static_cast<int>(layers.size());
+    }
+    layers.insert(layers.begin() + index, layer);
+    stack_changed();
+}
+
+bool Display::is_default(RLayer const* layer) const
+{
+    return layer == console.get() || layer == canvas.get() ||
+           layer == sprites.get();
+}
+
+std::shared_ptr<RLayer> Display::find_layer(RLayer const* layer) const
+{
+    if (layer == console.get()) { return console; }
+    if (layer == canvas.get()) { return canvas; }
+    if (layer == sprites.get()) { return sprites; }
+    for (auto const& [data, h] : handles) {
+        if (h.layer.get() == layer) { return h.layer; }
+    }
+    return nullptr;
+}
 
+size_t Display::static_run_end(size_t begin) const
+{
+    while (begin < layers.size() && layers[begin]->is_static()) {
+        begin++;
+    }
+    return begin;
+}
+
+void Display::render_layer(RLayer& layer)
+{
+    auto t = FrameTimer::default_timer->scope(layer.name());
+    layer.render();
+    layer.mark_clean();
+}
+
+void Display::composite(size_t cache_index, size_t begin, size_t end)
+{
+    if (caches.size() <= cache_index) { caches.resize(cache_index + 1); }
+    auto& cache = caches[cache_index];
+    bool const bottom = begin == 0;
+
+    bool dirty = !cache.valid;
+    for (auto i = begin; i < end; i++) {
+        dirty = dirty || layers[i]->is_dirty();
+    }
+    if (dirty) {
+        auto t = FrameTimer::default_timer->scope("composite");
+        if (cache.texture.width != static_cast<GLuint>(width) ||
+            cache.texture.height != static_cast<GLuint>(height)) {
+            cache.texture = gl::Texture{width, height};
+        }
+        cache.texture.set_target();
+        gl::clearColor(bottom ? gl::Color{bg} : gl::Color{0});
+        glClear(GL_COLOR_BUFFER_BIT);
+        gl::blendAlphaCoverage(!bottom);
+        for (auto i = begin; i < end; i++) {
+            render_layer(*layers[i]);
+        }
+        gl::blendAlphaCoverage(false);
+        gl::bindFramebuffer(0);
+        gl::setViewport({width, height});
+        cache.valid = true;
+    }
+
+    cache.texture.bind();
+    pix::set_transform(Id);
+    pix::set_colors(0xffffffff, 0);
+    gl::ProgramCache::get_instance().textured.use();
+    if (bottom) {
+        // Covers the whole screen, so this replaces the clear
+        glDisable(GL_BLEND);
+    } else {
+        gl::blendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
+    }
+    pix::draw_quad();
+    glEnable(GL_BLEND);
+    gl::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+}
+
+// Runs of two or more static layers are drawn from a cache, which is only
+// redrawn when one of them is dirty. Single layers gain nothing from
+// caching and are drawn directly.
+void Display::end_draw()
+{
+    released.clear();
+    gl::bindFramebuffer(0);
     gl::setViewport({width, height});
-    console->render();
-    canvas->render();
-    sprites->render();
+
+    if (static_run_end(0) < 2) {
+        gl::clearColor({bg});
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+
+    size_t cache_index = 0;
+    size_t i = 0;
+    while (i < layers.size()) {
+        auto end = static_run_end(i);
+        if (end - i >= 2) {
+            composite(cache_index++, i, end);
+            i = end;
+        } else {
+            render_layer(*layers[i]);
+            i++;
+        }
+    }
 }
 
 void Display::swap()
@@ -99,9 +232,45 @@ void Display::reset()
     console->reset();
     canvas->reset();
     sprites->reset();
+    // Layers added by ruby go when scripts no longer refer to them
+    for (auto const& [data, h] : handles) {
+        h.layer->reset();
+    }
+    default_layers();
+    released.clear();
     SET_NIL_VALUE(draw_handler);
 }
 
+mrb_value Display::layer_value(
+    mrb_state* mrb, std::shared_ptr<RLayer> const& layer)
+{
+    mrb_value obj = mrb_nil_value();
+    if (auto* c = dynamic_cast<RConsole*>(layer.get())) {
+        obj = mrb::new_data_obj(mrb, c);
+    } else if (auto* c = dynamic_cast<RCanvas*>(layer.get())) {
+        obj = mrb::new_data_obj(mrb, c);
+    } else if (auto* s = dynamic_cast<RSprites*>(layer.get())) {
+        obj = mrb::new_data_obj(mrb, s);
+    }
+    // The default layers belong to the display
+    if (mrb_nil_p(obj) || is_default(layer.get())) { return obj; }
+    auto& h = handles[DATA_PTR(obj)];
+    h.layer = layer;
+    h.count++;
+    DATA_TYPE(obj) = &handle_dt; // NOLINT
+    return obj;
+}
+
+static RLayer* to_layer(mrb_state* mrb, mrb_value obj)
+{
+    if (mrb_type(obj) != MRB_TT_DATA ||
+        !mrb_obj_is_kind_of(mrb, obj, RLayer::rclass) ||
+        DATA_PTR(obj) == nullptr) {
+        mrb_raise(mrb, E_ARGUMENT_ERROR, "Expected a layer");
+    }
+    return mrb::self_to<RLayer>(obj);
+}
+
 void Display::reg_class(
     mrb_state* ruby, System& system, Settings const& settings)
 {
@@ -184,6 +353,83 @@ void Display::reg_class(
         },
         MRB_ARGS_NONE());
 
+    mrb_define_method(
+        ruby, Display::rclass, "layers",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* display = mrb::self_to<Display>(self);
+            auto arr = mrb_ary_new_capa(
+                mrb, static_cast<mrb_int>(display->layers.size()));
+            for (auto const& layer : display->layers) {
+                mrb_ary_push(mrb, arr, display->layer_value(mrb, layer));
+            }
+            return arr;
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, Display::rclass, "add_canvas",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* display = mrb::self_to<Display>(self);
+            mrb_int index = -1;
+            mrb_get_args(mrb, "|i", &index);
+            auto canvas =
+                std::make_shared<RCanvas>(display->width, display->height);
+            canvas->init(mrb);
+            canvas->clear();
+            display->insert_layer(canvas, static_cast<int>(index));
+            return display->layer_value(mrb, canvas);
+        },
+        MRB_ARGS_OPT(1));
+
+    mrb_define_method(
+        ruby, Display::rclass, "add_console",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* display = mrb::self_to<Display>(self);
+            mrb_int index = -1;
+            mrb_get_args(mrb, "|i", &index);
+            auto console = std::make_shared<RConsole>(display->width,
+                display->height,
+                Style{0xffffffff, 0x00008000,
+                    display->settings.console_font.string(),
+                    display->settings.font_size});
+            display->insert_layer(console, static_cast<int>(index));
+            return display->layer_value(mrb, console);
+        },
+        MRB_ARGS_OPT(1));
+
+    // Also moves a layer that is already in the stack
+    mrb_define_method(
+        ruby, Display::rclass, "add_layer",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* display = mrb::self_to<Display>(self);
+            mrb_value obj;
+            mrb_int index = -1;
+            mrb_get_args(mrb, "o|i", &obj, &index);
+            auto layer = display->find_layer(to_layer(mrb, obj));
+            if (layer == nullptr) {
+                mrb_raise(mrb, E_ARGUMENT_ERROR, "Not a layer of this display");
+            }
+            display->insert_layer(layer, static_cast<int>(index));
+            return mrb_nil_value();
+        },
+        MRB_ARGS_ARG(1, 1));
+
+    mrb_define_method(
+        ruby, Display::rclass, "remove_layer",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* display = mrb::self_to<Display>(self);
+            auto [obj] = mrb::get_args<mrb_value>(mrb);
+            auto const* layer = to_layer(mrb, obj);
+            auto& layers = display->layers;
+            auto it = std::find_if(layers.begin(), layers.end(),
+                [&](auto const& l) { return l.get() == layer; });
+            if (it == layers.end()) { return mrb_false_value(); }
+            layers.erase(it);
+            display->stack_changed();
+            return mrb_true_value();
+        },
+        MRB_ARGS_REQ(1));
+
     mrb_define_method(
         ruby, Display::rclass, "reset",
         [](mrb_state* /*mrb*/, mrb_value self) -> mrb_value {
@@ -210,6 +456,8 @@ void Display::reg_class(
             auto [av] = mrb::get_args<mrb_value>(mrb);
             auto* display = mrb::self_to<Display>(self);
             display->bg = mrb::to_array<float, 4>(av, mrb);
+            // The bottom layer cache is drawn on top of bg
+            display->stack_changed();
             return mrb_nil_value();
         },
         MRB_ARGS_REQ(1));
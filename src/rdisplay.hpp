@@ -5,12 +5,15 @@
 #include "system.hpp"
 
 #include "mrb_tools.hpp"
+#include <gl/texture.hpp>
 #include <mruby.h>
 #include <mruby/data.h>
 
 #include <array>
 #include <memory>
 #include <string>
+#include <unordered_map>
+#include <vector>
 
 class RConsole;
 class RCanvas;
@@ -32,6 +35,43 @@ class Display : public RLayer
     std::shared_ptr<RCanvas> canvas;
     std::shared_ptr<RSprites> sprites;
 
+    // Layers drawn by `end_draw()`, bottom first
+    std::vector<std::shared_ptr<RLayer>> layers;
+    // Layers made by ruby. Each ruby handle to one holds a reference, so
+    // a layer lives while it is in the stack or ruby can still reach it.
+    struct Handles
+    {
+        std::shared_ptr<RLayer> layer;
+        int count = 0;
+    };
+    // Keyed by the data pointer of the handles
+    std::unordered_map<void const*, Handles> handles;
+    // Layers whose last handle went during a GC, freed by the next
+    // end_draw() or reset()
+    std::vector<std::shared_ptr<RLayer>> released;
+    static void free_handle(mrb_state* mrb, void* data);
+    static mrb_data_type handle_dt;
+
+    // Composited copy of a run of static layers. The bottom run is drawn
+    // on top of `bg` and is opaque, others are premultiplied.
+    struct LayerCache
+    {
+        gl_wrap::Texture texture;
+        bool valid = false;
+    };
+    std::vector<LayerCache> caches;
+
+    void default_layers();
+    void insert_layer(std::shared_ptr<RLayer> const& layer, int index);
+    std::shared_ptr<RLayer> find_layer(RLayer const* layer) const;
+    bool is_default(RLayer const* layer) const;
+    void stack_changed() { caches.clear(); }
+    size_t static_run_end(size_t begin) const;
+    void render_layer(RLayer& layer);
+    void composite(size_t cache_index, size_t begin, size_t end);
+    mrb_value layer_value(
+        mrb_state* mrb, std::shared_ptr<RLayer> const& layer);
+
 public:
     RSprite* mouse_cursor = nullptr;
     std::shared_ptr<RConsole> console;
@@ -42,6 +82,8 @@ public:
 
     void setup();
     void reset() override;
+    // Free the layers made by ruby, while the ruby state is still open
+    void release_layers();
     bool begin_draw();
     void end_draw();
     void swap();
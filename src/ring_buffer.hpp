@@ -3,6 +3,7 @@
 #include <array>
 #include <atomic>
 #include <fmt/format.h>
+#include <utility>
 #include <vector>
 
 template <typename T, size_t SIZE>
@@ -61,3 +62,35 @@ struct Ring
     // Available to read
     size_t available() const { return write_pos - read_pos; }
 };
+
+// Lock free single producer / single consumer queue. One thread may `push()`
+// and one (other) thread may `pop()`, neither of them will ever block.
+template <typename T, size_t SIZE>
+struct Queue
+{
+    std::array<T, SIZE> data;
+    std::atomic<size_t> read_pos{0};
+    std::atomic<size_t> write_pos{0};
+
+    bool push(T&& t)
+    {
+        auto wp = write_pos.load(std::memory_order_relaxed);
+        if (wp - read_pos.load(std::memory_order_acquire) == SIZE) {
+            return false;
+        }
+        data[wp % SIZE] = std::move(t);
+        write_pos.store(wp + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& t)
+    {
+        auto rp = read_pos.load(std::memory_order_relaxed);
+        if (rp == write_pos.load(std::memory_order_acquire)) { return false; }
+        t = std::move(data[rp % SIZE]);
+        read_pos.store(rp + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const { return read_pos == write_pos; }
+};
@@ -6,8 +6,11 @@
 #include "settings.hpp"
 
 #include <coreutils/utf8.h>
+#include <mruby/array.h>
 #include <mruby/class.h>
 
+#include <chrono>
+
 #include <fmt/format.h>
 
 RInput::RInput(mrb_state* _ruby, System& _system) : ruby{_ruby}, system{_system}
@@ -25,6 +28,10 @@ bool RInput::handle_event(KeyEvent const& e)
         return true;
     }
     auto mod = e.mods;
+    if (batched()) {
+        queue(Key, static_cast<int>(code), static_cast<int>(mod));
+        return false;
+    }
     call_proc(ruby, key_handler, code, mod);
     return false;
 }
@@ -41,11 +48,28 @@ bool RInput::handle_event(NoEvent const&)
 }
 bool RInput::handle_event(ClickEvent const& me)
 {
+    if (batched()) {
+        queue(Click, me.x, me.y, me.buttons);
+        return false;
+    }
     call_proc(ruby, click_handler, me.x, me.y);
     return false;
 }
 bool RInput::handle_event(MoveEvent const& me)
 {
+    if (batched()) {
+        if (me.buttons != 0) {
+            // Only the latest move of a run of moves is interesting, with
+            // its own position and time
+            if (!queued.empty() && queued.back().type == Drag) {
+                queued.pop_back();
+            }
+            queue(Drag, me.x, me.y, me.buttons);
+        }
+        mouse_x = me.x;
+        mouse_y = me.y;
+        return false;
+    }
     if(last_frame != frame_counter) {
         if (me.buttons != 0) {
             //fmt::print("{:x} {} {}\n", me.buttons, me.x, me.y);
@@ -62,16 +86,48 @@ bool RInput::handle_event(TextEvent const& me)
     fmt::print("TEXT '{}'\n", me.text);
     auto text32 = utils::utf8_decode(me.text);
     for (auto s : text32) {
-        call_proc(ruby, key_handler, s, 0);
+        put_char(s);
     }
     return false;
 }
 
 void RInput::put_char(char32_t c)
 {
+    if (batched()) {
+        queue(Key, static_cast<int>(c), 0);
+        return;
+    }
     call_proc(ruby, key_handler, c, 0);
 }
 
+void RInput::queue(EventType type, int a, int b, int c)
+{
+    using namespace std::chrono;
+    static auto const start = steady_clock::now();
+    auto ms = duration_cast<milliseconds>(steady_clock::now() - start);
+    queued.push_back({type, a, b, c, static_cast<int>(ms.count())});
+}
+
+void RInput::flush_events()
+{
+    if (queued.empty()) { return; }
+    if (!batched()) {
+        queued.clear();
+        return;
+    }
+    auto ai = mrb_gc_arena_save(ruby);
+    auto events = mrb_ary_new_capa(
+        ruby, static_cast<mrb_int>(queued.size()) * event_stride);
+    for (auto const& e : queued) {
+        for (int v : {static_cast<int>(e.type), e.a, e.b, e.c, e.time}) {
+            mrb_ary_push(ruby, events, mrb_int_value(ruby, v));
+        }
+    }
+    queued.clear();
+    call_proc(ruby, events_handler, events);
+    mrb_gc_arena_restore(ruby, ai);
+}
+
 bool RInput::should_reset()
 {
     auto res = do_reset;
@@ -82,6 +138,7 @@ bool RInput::update()
 {
     while (!std::visit([&](auto const& e) { return handle_event(e); },
         system.poll_events())) {}
+    flush_events();
     if (resize > 0) {
         resize--;
         if (resize == 0) { do_reset = true; }
@@ -94,6 +151,8 @@ void RInput::reset()
     SET_NIL_VALUE(key_handler);
     SET_NIL_VALUE(click_handler);
     SET_NIL_VALUE(drag_handler);
+    SET_NIL_VALUE(events_handler);
+    queued.clear();
 }
 void RInput::reg_class(mrb_state* ruby, System& system)
 {
@@ -201,6 +260,23 @@ void RInput::reg_class(mrb_state* ruby, System& system)
             return mrb_nil_value();
         },
         MRB_ARGS_BLOCK());
+    mrb_define_const(ruby, rclass, "KEY", mrb_int_value(ruby, Key));
+    mrb_define_const(ruby, rclass, "CLICK", mrb_int_value(ruby, Click));
+    mrb_define_const(ruby, rclass, "DRAG", mrb_int_value(ruby, Drag));
+    mrb_define_const(
+        ruby, rclass, "EVENT_SIZE", mrb_int_value(ruby, event_stride));
+
+    mrb_define_method(
+        ruby, rclass, "on_events",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto* input = mrb::self_to<RInput>(self);
+            mrb_get_args(mrb, "&", &input->events_handler);
+            if (input->batched()) {
+                mrb_gc_register(mrb, input->events_handler);
+            }
+            return mrb_nil_value();
+        },
+        MRB_ARGS_BLOCK());
     mrb_define_method(
         ruby, rclass, "on_click",
         [](mrb_state* mrb, mrb_value self) -> mrb_value {
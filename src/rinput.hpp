@@ -7,6 +7,7 @@
 #include <mruby/data.h>
 
 #include <unordered_map>
+#include <vector>
 
 class RInput
 {
@@ -19,6 +20,31 @@ class RInput
     mrb_value click_handler{};
     mrb_value drag_handler{};
 
+    // Batched delivery. When `events_handler` is set, events are queued
+    // and handed to it once per frame as one flat array, instead of
+    // calling the handlers above once per event.
+    enum EventType
+    {
+        Key = 0,
+        Click = 1,
+        Drag = 2,
+    };
+    struct QueuedEvent
+    {
+        EventType type;
+        int a;
+        int b;
+        int c;
+        int time;
+    };
+    static constexpr int event_stride = 5;
+    mrb_value events_handler{};
+    std::vector<QueuedEvent> queued;
+
+    bool batched() const { return events_handler.w != 0; }
+    void queue(EventType type, int a, int b, int c = 0);
+    void flush_events();
+
     int resize = 0;
     int mouse_x = 0;
     int mouse_y = 0;
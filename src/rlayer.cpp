@@ -182,6 +182,7 @@ void RLayer::reg_class(mrb_state* ruby)
             auto [e] = mrb::get_args<bool>(mrb);
             auto* rlayer = mrb::self_to<RLayer>(self);
             rlayer->enabled = e;
+            rlayer->dirty = true;
             return mrb_nil_value();
         },
         MRB_ARGS_REQ(1));
@@ -210,6 +211,7 @@ void RLayer::reg_class(mrb_state* ruby)
             auto* rlayer = mrb::self_to<RLayer>(self);
             rlayer->scale = mrb::to_array<float, 2>(av, mrb);
             rlayer->update_tx();
+            rlayer->dirty = true;
             return mrb_nil_value();
         },
         MRB_ARGS_REQ(1));
@@ -229,6 +231,7 @@ void RLayer::reg_class(mrb_state* ruby)
             auto* rlayer = mrb::self_to<RLayer>(self);
             rlayer->trans = mrb::to_array<float, 2>(av, mrb);
             rlayer->update_tx();
+            rlayer->dirty = true;
             return mrb_nil_value();
         },
         MRB_ARGS_REQ(2));
@@ -240,6 +243,7 @@ void RLayer::reg_class(mrb_state* ruby)
             auto* rlayer = mrb::self_to<RLayer>(self);
             rlayer->rot = static_cast<float>(x);
             rlayer->update_tx();
+            rlayer->dirty = true;
             return mrb::to_value(rlayer->rot, mrb);
         },
         MRB_ARGS_REQ(1));
@@ -260,4 +264,5 @@ void RLayer::reset()
     scale = {1.0F, 1.0F};
     rot = 0;
     update_tx();
+    dirty = true;
 }
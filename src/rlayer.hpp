@@ -42,6 +42,10 @@ protected:
 
     bool enabled = true;
 
+    // Set when the layer may look different from the last time it was
+    // rendered
+    bool dirty = true;
+
     mrb::RubyPtr stylep;
     RStyle& current_style;
 
@@ -65,5 +69,17 @@ public:
     virtual void update_tx();
 
     virtual void enable(bool en = true) { enabled = en; }
+
+    // Name of the layer in frame timings
+    virtual char const* name() const { return "layer"; }
+
+    // Static layers only change when drawn to, and mark themselves dirty
+    // when that happens. The display keeps composited copies of them.
+    // Layers that are expected to change every frame return false.
+    virtual bool is_static() const { return true; }
+    virtual bool is_dirty() const { return dirty; }
+    void mark_dirty() { dirty = true; }
+    // Called by the display after rendering the layer
+    virtual void mark_clean() { dirty = false; }
 };
 
@@ -1,18 +1,186 @@
 #include "rspeech.hpp"
+#include "error.hpp"
 #include "raudio.hpp"
 
 #include <flite.h>
 
 extern "C" cst_voice* register_cmu_us_kal(const char* voxdir);
 
-RSpeech::RSpeech(mrb_state* mrb) : ruby{mrb}
+RSpeech::RSpeech(mrb_state* mrb) : ruby{mrb}, cache{cache_dir / "speech"}
 {
     flite_init();
-    voice = register_cmu_us_kal(nullptr);
+    auto* v = register_cmu_us_kal(nullptr);
+    voice = v;
+    voice_name = v->name;
+
+    // Have the synthesizer hand us samples as they are produced
+    auto* asi = new_audio_streaming_info();
+    asi->asc = &RSpeech::stream_chunk;
+    asi->userdata = this;
+    feat_set(v->features, "streaming_info", audio_streaming_info_val(asi));
+
+#ifndef __EMSCRIPTEN__
+    speech_thread = std::thread{&RSpeech::run, this};
+#endif
+}
+
+RSpeech::~RSpeech()
+{
+    {
+        std::lock_guard lock{m};
+        quit = true;
+    }
+    cv.notify_all();
+    if (speech_thread.joinable()) { speech_thread.join(); }
+}
+
+// flite has no way to ask a voice for its sample rate, but we need it
+// before the first samples of a stream are produced. Found by
+// synthesizing a short sound the first time it is needed, so it is not
+// done at startup, and not at all if everything comes from the cache.
+float RSpeech::output_rate()
+{
+    std::call_once(rate_known, [this] {
+        std::lock_guard lock{flite_mutex};
+        if (auto* wav =
+                flite_text_to_wave("a", static_cast<cst_voice*>(voice))) {
+            sample_rate = static_cast<float>(wav->sample_rate);
+            delete_wave(wav);
+        }
+    });
+    return sample_rate;
+}
+
+// Called by flite during synthesis, with the lock held
+int RSpeech::stream_chunk(cst_wave_struct const* w, int start, int size,
+    int last, cst_audio_streaming_info_struct* asi)
+{
+    auto* speech = static_cast<RSpeech*>(asi->userdata);
+    auto* job = speech->current;
+    if (job == nullptr) { return CST_AUDIO_STREAM_CONT; }
+    job->pcm.insert(
+        job->pcm.end(), w->samples + start, w->samples + start + size);
+    if (auto* stream = job->stream.get()) {
+        std::array<float, 1024> temp; // NOLINT
+        while (size > 0) {
+            auto n = std::min(size, static_cast<int>(temp.size()));
+            convert(w->samples + start, temp.data(), n);
+            stream->push(temp.data(), n);
+            start += n;
+            size -= n;
+        }
+    }
+    return CST_AUDIO_STREAM_CONT;
+}
+
+void RSpeech::synthesize(Job& job)
+{
+    auto key = SpeechCache::key(voice_name, job.text, job.rate);
+    auto freq = output_rate();
+    {
+        std::lock_guard lock{flite_mutex};
+        auto* v = static_cast<cst_voice*>(voice);
+        feat_set_float(v->features, "duration_stretch", 1.0F / job.rate);
+        current = &job;
+        flite_text_to_speech(job.text.c_str(), v, "none");
+        current = nullptr;
+    }
+    if (job.stream) { job.stream->finish(); }
+    cache.put(key, freq, std::move(job.pcm));
+}
+
+void RSpeech::queue(Job&& job)
+{
+#ifdef __EMSCRIPTEN__
+    // No threads; synthesize all of it now
+    synthesize(job);
+#else
+    {
+        std::lock_guard lock{m};
+        jobs.push_back(std::move(job));
+    }
+    cv.notify_all();
+#endif
+}
+
+void RSpeech::run()
+{
+    while (true) {
+        Job job;
+        {
+            std::unique_lock lock{m};
+            cv.wait(lock, [&] { return quit || !jobs.empty(); });
+            if (quit) { return; }
+            job = std::move(jobs.front());
+            jobs.pop_front();
+        }
+        synthesize(job);
+    }
+}
+
+std::shared_ptr<BufferedStream> RSpeech::say_async(std::string const& text)
+{
+    if (auto entry = cache.get(SpeechCache::key(voice_name, text, rate))) {
+        // Already synthesized, so the stream can be completed right away
+        auto stream = std::make_shared<BufferedStream>(entry->freq);
+        RAudio::default_audio->add_stream(stream);
+        auto const& pcm = std::get<std::vector<int16_t>>(*entry->samples);
+        std::array<float, 1024> temp; // NOLINT
+        for (size_t i = 0; i < pcm.size(); i += temp.size()) {
+            auto n = std::min(temp.size(), pcm.size() - i);
+            convert(pcm.data() + i, temp.data(), n);
+            stream->push(temp.data(), n);
+        }
+        stream->finish();
+        stream->fill();
+        return stream;
+    }
+    auto stream = std::make_shared<BufferedStream>(output_rate());
+    RAudio::default_audio->add_stream(stream);
+    queue({text, rate, stream, {}});
+    return stream;
+}
+
+void RSpeech::precache(std::string const& text)
+{
+    if (!cache.get(SpeechCache::key(voice_name, text, rate))) {
+        queue({text, rate, nullptr, {}});
+    }
+}
+
+SpeechCache::Entry RSpeech::text_to_samples(std::string const& text)
+{
+    auto key = SpeechCache::key(voice_name, text, rate);
+    if (auto entry = cache.get(key)) { return *entry; }
+    Job job{text, rate, nullptr, {}};
+    synthesize(job);
+    return *cache.get(key);
+}
+
+void RSpeech::update()
+{
+    // Move finished entries out first; the blocks may queue more speech
+    std::vector<mrb::RubyPtr> done;
+    callbacks.erase(std::remove_if(callbacks.begin(), callbacks.end(),
+                        [&](auto& cb) {
+                            if (!cb.first->finished(0)) { return false; }
+                            done.push_back(std::move(cb.second));
+                            return true;
+                        }),
+        callbacks.end());
+    for (auto& blk : done) {
+        call_proc(ruby, blk);
+    }
+}
+
+void RSpeech::reset()
+{
+    callbacks.clear();
 }
 
-void RSpeech::reg_class(mrb_state* ruby)
+void RSpeech::reg_class(mrb_state* ruby, Settings const& settings)
 {
+    cache_dir = settings.cache_dir;
     rclass = mrb_define_class(ruby, "Speech", ruby->object_class);
     MRB_SET_INSTANCE_TT(RSpeech::rclass, MRB_TT_DATA);
 
@@ -32,19 +200,62 @@ void RSpeech::reg_class(mrb_state* ruby)
             auto [text] = mrb::get_args<std::string>(mrb);
 
             auto* speech = mrb::self_to<RSpeech>(self);
-            auto* wav = flite_text_to_wave(
-                text.c_str(), static_cast<cst_voice*>(speech->voice));
-            fmt::print("SPEECH {} {}\n", wav->num_samples, wav->sample_rate);
-
+            auto entry = speech->text_to_samples(text);
             auto* sound = new Sound();
-            sound->freq = static_cast<float>(wav->sample_rate);
-            sound->channels = wav->num_channels;
-            sound->data.resize(wav->num_samples);
-            for (size_t i = 0; i < sound->data.size(); i++) {
-                sound->data[i] = static_cast<float>(wav->samples[i]) / 0x7fff;
-            }
-            delete_wave(wav);
+            sound->freq = entry.freq;
+            sound->channels = 1;
+            sound->data = entry.samples;
             return mrb::new_data_obj(mrb, sound);
         },
         MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, RSpeech::rclass, "rate=",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [r] = mrb::get_args<float>(mrb);
+            mrb::self_to<RSpeech>(self)->rate = std::clamp(r, 0.1F, 10.0F);
+            return mrb_nil_value();
+        },
+        MRB_ARGS_REQ(1));
+
+    mrb_define_method(
+        ruby, RSpeech::rclass, "rate",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            return mrb::to_value(mrb::self_to<RSpeech>(self)->rate, mrb);
+        },
+        MRB_ARGS_NONE());
+
+    mrb_define_method(
+        ruby, RSpeech::rclass, "precache",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            auto [text] = mrb::get_args<std::string>(mrb);
+            mrb::self_to<RSpeech>(self)->precache(text);
+            return self;
+        },
+        MRB_ARGS_REQ(1));
+
+    // say_async(text) { done }
+    // Speak text on a free channel without waiting for synthesis. Returns
+    // the Stream, so `done?` can also be polled. If no channel is free the
+    // block is called at once and nil is returned.
+    mrb_define_method(
+        ruby, RSpeech::rclass, "say_async",
+        [](mrb_state* mrb, mrb_value self) -> mrb_value {
+            char const* text = nullptr;
+            mrb_value blk{};
+            mrb_get_args(mrb, "z&", &text, &blk);
+            auto* speech = mrb::self_to<RSpeech>(self);
+            auto stream = speech->say_async(text);
+            auto voice = RAudio::default_audio->play_stream(stream);
+            if (voice.channels[0] < 0) {
+                // Nothing will ever read the stream, so it never finishes
+                if (!mrb_nil_p(blk)) { call_proc(mrb, blk); }
+                return mrb_nil_value();
+            }
+            if (!mrb_nil_p(blk)) {
+                speech->callbacks.emplace_back(stream, mrb::RubyPtr{mrb, blk});
+            }
+            return mrb::new_data_obj(mrb, new Stream{stream});
+        },
+        MRB_ARGS_REQ(1) | MRB_ARGS_BLOCK());
 }
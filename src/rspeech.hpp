@@ -1,16 +1,87 @@
 #pragma once
 #include "mrb_tools.hpp"
+#include "settings.hpp"
+#include "speech_cache.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+class BufferedStream;
+struct cst_wave_struct;
+struct cst_audio_streaming_info_struct;
 
 class RSpeech
 {
+    struct Job
+    {
+        std::string text;
+        float rate = 1.0F;
+        // May be null if we are only filling the cache
+        std::shared_ptr<BufferedStream> stream;
+        std::vector<int16_t> pcm;
+    };
+
     void* voice;
+    std::string voice_name;
     mrb_state* ruby;
-    static inline RSpeech* default_speech = nullptr;
+    // Output rate of the voice, see output_rate()
+    float sample_rate = 8000;
+    std::once_flag rate_known;
+    // Speaking rate, 1 is normal speed
+    float rate = 1.0F;
+
+    static inline std::filesystem::path cache_dir;
+    SpeechCache cache;
+
+    // flite is not thread safe, so all synthesis holds this lock
+    std::mutex flite_mutex;
+    // Job currently being synthesized, written by the flite callback
+    Job* current = nullptr;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<Job> jobs;
+    bool quit = false;
+    std::thread speech_thread;
+
+    // Streams with a ruby block to call when they are done
+    std::vector<std::pair<std::shared_ptr<BufferedStream>, mrb::RubyPtr>>
+        callbacks;
+
+    void run();
+    float output_rate();
+    void synthesize(Job& job);
+    void queue(Job&& job);
+    static int stream_chunk(cst_wave_struct const* w, int start, int size,
+        int last, cst_audio_streaming_info_struct* asi);
+
 public:
+    static inline RSpeech* default_speech = nullptr;
     static inline RClass* rclass;
     static inline mrb_data_type dt{"Speech", [](mrb_state*, void* data) {}};
 
     explicit RSpeech(mrb_state*);
+    ~RSpeech();
+
+    // Start synthesizing `text` in the background. Samples can be played
+    // from the stream as soon as they are produced.
+    std::shared_ptr<BufferedStream> say_async(std::string const& text);
+
+    // Synthesize `text` into the cache in the background, unless it
+    // is already there
+    void precache(std::string const& text);
+
+    // Synthesize now, or get it from the cache
+    SpeechCache::Entry text_to_samples(std::string const& text);
+
+    // Call completion blocks; main thread, every frame
+    void update();
     void reset();
-    static void reg_class(mrb_state* ruby);
+    static void reg_class(mrb_state* ruby, Settings const& settings);
 };
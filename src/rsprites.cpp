@@ -63,7 +63,9 @@ void RSprite::update_tx(double screen_width, double screen_height)
 }
 
 RSprites::RSprites(int w, int h) : RLayer{w, h} {
-    program = gl_wrap::Program(gl_wrap::VertexShader{vertex_shader}, gl_wrap::FragmentShader{fragment_shader});
+    // Shared by every RSprites, so a new Display does not recompile it
+    program = gl_wrap::ProgramRegistry::get().get_program(
+        vertex_shader, fragment_shader);
 }
 
 void RSprites::reset()
@@ -83,7 +85,7 @@ void RSprites::render()
     glEnable(GL_BLEND);
     glLineWidth(current_style.line_width);
     pix::set_colors(current_style.fg, current_style.bg);
-    auto& textured = program;//gl::ProgramCache::get_instance().textured;
+    auto& textured = *program;//gl::ProgramCache::get_instance().textured;
     textured.use();
     float last_alpha = -1;
     auto pos = textured.getAttribute("in_pos");
@@ -44,7 +44,7 @@ class RSprites : public RLayer
 {
     std::unordered_map<GLuint, SpriteBatch> batches;
     SpriteBatch fixed_batch;
-    gl_wrap::Program program;
+    std::shared_ptr<gl_wrap::Program> program;
 public:
     RSprite* add_sprite(RImage* image, int flags);
     static void remove_sprite(RSprite* spr);
@@ -55,6 +55,9 @@ public:
     RSprites(int w, int h);
     void render() override;
     void reset() override;
+    char const* name() const override { return "sprites"; }
+    // Sprites are expected to move, so they are always drawn directly
+    bool is_static() const override { return false; }
     void clear();
     static void reg_class(mrb_state* ruby);
 };
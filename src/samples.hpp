@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <variant>
+#include <vector>
+
+// Formats sample data can be stored in. Order matches `SampleData`.
+enum class SampleFormat
+{
+    Float,
+    Int16,
+    UInt8
+};
+
+// Sound samples are kept in the format they were loaded in, and converted
+// to float when mixed
+using SampleData = std::variant<std::vector<float>, std::vector<int16_t>,
+    std::vector<uint8_t>>;
+
+inline float to_float(float s)
+{
+    return s;
+}
+
+inline float to_float(int16_t s)
+{
+    return static_cast<float>(s) * (1.0F / 32768.0F);
+}
+
+// 8 bit samples are unsigned, centered around 128
+inline float to_float(uint8_t s)
+{
+    return static_cast<float>(static_cast<int>(s) - 128) * (1.0F / 128.0F);
+}
+
+// Plain loop over contiguous data, so the compiler can vectorize it
+template <typename T>
+void convert(T const* src, float* out, size_t n)
+{
+    for (size_t i = 0; i < n; i++) {
+        out[i] = to_float(src[i]);
+    }
+}
@@ -39,7 +39,7 @@ public:
     std::shared_ptr<Screen> init_screen(Settings const& settings) override
     {
 
-        SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO);
+        SDL_Init(SDL_INIT_VIDEO);
         auto* window = SDL_CreateWindow("Toy", SDL_WINDOWPOS_UNDEFINED,
             SDL_WINDOWPOS_UNDEFINED,
 #ifdef OSX
@@ -55,6 +55,7 @@ public:
         // SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
         // SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
         SDL_GL_CreateContext(window);
+        SDL_GL_SetSwapInterval(settings.vsync ? 1 : 0);
 #ifndef USE_GLES
         GLenum err = glewInit();
 #endif
@@ -132,19 +133,24 @@ public:
         return NoEvent{};
     }
 #ifdef USE_ASOUND
-    void init_audio(Settings const&) override
+    void init_audio(Settings const& settings) override
     {
-        player = std::make_unique<LinuxPlayer>(44100);
+        player = std::make_unique<LinuxPlayer>(
+            44100, settings.audio_buffer, settings.audio_periods);
     }
 
+    int audio_underruns() override { return player->underruns; }
+
     void set_audio_callback(
         std::function<void(float*, size_t)> const& fcb) override
     {
 
-        player->play([fcb](int16_t* data, size_t sz) {
-            std::array<float, 32768> fa; // NOLINT
+        player->play([fcb, fa = std::vector<float>()](
+                         int16_t* data, size_t sz) mutable {
+            // Only allocates on the first call
+            if (fa.size() < sz) { fa.resize(sz); }
             fcb(fa.data(), sz);
-            for (int i = 0; i < sz; i++) {
+            for (size_t i = 0; i < sz; i++) {
                 auto f = std::clamp(fa[i], -1.0F, 1.0F);
                 data[i] = static_cast<int16_t>(f * 32767.0);
             }
@@ -161,6 +167,7 @@ public:
 
     void init_audio(Settings const& settings) override
     {
+        SDL_InitSubSystem(SDL_INIT_AUDIO);
         SDL_AudioSpec want;
         SDL_AudioSpec have;
 
@@ -168,7 +175,14 @@ public:
         want.freq = 44100;
         want.format = AUDIO_F32;
         want.channels = 2;
-        want.samples = 4096;
+        // SDL has no period count, it only lets us set the callback size,
+        // which must be a power of two that fits in 16 bits
+        int frames = settings.audio_buffer > 0 ? settings.audio_buffer : 4096;
+        Uint16 samples = 32768;
+        while (samples > 64 && samples / 2 >= frames) {
+            samples /= 2;
+        }
+        want.samples = samples;
         want.userdata = this;
         want.callback = [](void* userdata, Uint8* stream, int len) {
             if (stream == nullptr || len < 0) {
@@ -182,7 +196,8 @@ public:
         dev = SDL_OpenAudioDevice(nullptr, 0, &want, &have,
             SDL_AUDIO_ALLOW_ANY_CHANGE & (~SDL_AUDIO_ALLOW_FORMAT_CHANGE));
 
-        fmt::print("Audio format {} {} vs {}\n", have.format, have.freq, dev);
+        fmt::print("Audio format {} {} vs {}, {} frames\n", have.format,
+            have.freq, dev, have.samples);
         SDL_PauseAudioDevice(dev, 0);
     }
 #endif
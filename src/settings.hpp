@@ -19,6 +19,27 @@ struct Settings
     int display_height = 960;
     std::string boot_cmd;
     bool console_benchmark = false;
+    bool dispatch_benchmark = false;
+    // If set, profile the whole session and write collapsed stacks here
+    path profile_file;
     std::string system;
+    // Frames per audio period, and number of periods in device buffer.
+    // 0 frames uses the backend default; 4096 for SDL, and the old 30 ms
+    // buffer for ALSA.
+    int audio_buffer = 0;
+    int audio_periods = 2;
+    // If set, write audio to this file instead of playing it
+    path audio_out;
+    // Quit after this many seconds of audio has been written
+    double audio_length = 0;
+    bool vsync = true;
+    // Milliseconds per frame to spend on garbage collection after the
+    // frame is shown. 0 leaves it to mruby.
+    double gc_budget = 2.0;
+    // Generated data that can be thrown away, relative to data root
+    path cache_dir = "cache";
+    // If set, system scripts are loaded from here instead of the copies
+    // built into the binary, so they can be edited without rebuilding
+    path sys_dir;
 };
 
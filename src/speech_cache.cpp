@@ -0,0 +1,134 @@
+#include "speech_cache.hpp"
+#include "hash.hpp"
+
+#include <fmt/format.h>
+
+#include <cstring>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// Header of a cache file, followed by the key it was saved under and
+// `frames` 16 bit samples. Files are named by a hash of the key, so the
+// key is checked on load in case two of them hash the same.
+struct Header
+{
+    char magic[4]; // NOLINT
+    uint32_t freq;
+    uint32_t frames;
+    uint32_t key_size;
+};
+
+constexpr char magic[] = "TSP2"; // NOLINT
+
+fs::path file_for(fs::path const& dir, std::string const& key)
+{
+    return dir / fmt::format("{:016x}.pcm", fnv1a(key.data(), key.size()));
+}
+
+} // namespace
+
+SpeechCache::SpeechCache(fs::path d, size_t cap)
+    : dir(std::move(d)), capacity(cap)
+{
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+}
+
+std::string SpeechCache::key(
+    std::string const& voice, std::string const& text, float rate)
+{
+    // The voice name and rate can't contain a newline, so parts can not
+    // run into each other
+    return fmt::format("{}\n{}\n{}", voice, rate, text);
+}
+
+void SpeechCache::remember(std::string const& key, Entry const& entry)
+{
+    if (auto it = index.find(key); it != index.end()) {
+        lru.erase(it->second);
+    }
+    lru.emplace_front(key, entry);
+    index[key] = lru.begin();
+    while (lru.size() > capacity) {
+        index.erase(lru.back().first);
+        lru.pop_back();
+    }
+}
+
+std::optional<SpeechCache::Entry> SpeechCache::get(std::string const& key)
+{
+    std::lock_guard lock{m};
+    if (auto it = index.find(key); it != index.end()) {
+        // Move to front
+        lru.splice(lru.begin(), lru, it->second);
+        return it->second->second;
+    }
+    auto entry = load(key);
+    if (entry) { remember(key, *entry); }
+    return entry;
+}
+
+std::optional<SpeechCache::Entry> SpeechCache::load(std::string const& key)
+{
+    auto name = file_for(dir, key);
+    std::ifstream in{name, std::ios::binary};
+    if (!in) { return std::nullopt; }
+    std::error_code ec;
+    auto size = fs::file_size(name, ec);
+    Header header{};
+    if (ec || !in.read(reinterpret_cast<char*>(&header), sizeof(Header)) ||
+        std::memcmp(header.magic, magic, 4) != 0 ||
+        size < sizeof(Header) + uint64_t{header.key_size} +
+                   uint64_t{header.frames} * sizeof(int16_t)) {
+        fmt::print("Bad speech cache file {}\n", name.string());
+        return std::nullopt;
+    }
+    std::string saved_key(header.key_size, '\0');
+    if (!in.read(saved_key.data(), header.key_size) || saved_key != key) {
+        return std::nullopt;
+    }
+    // Read straight into the sample buffer the mixer will use
+    std::vector<int16_t> pcm(header.frames);
+    if (!in.read(reinterpret_cast<char*>(pcm.data()),
+            static_cast<std::streamsize>(pcm.size() * sizeof(int16_t)))) {
+        fmt::print("Bad speech cache file {}\n", name.string());
+        return std::nullopt;
+    }
+    return Entry{static_cast<float>(header.freq),
+        std::make_shared<SampleData const>(std::move(pcm))};
+}
+
+void SpeechCache::put(
+    std::string const& key, float freq, std::vector<int16_t>&& pcm)
+{
+    save(key, freq, pcm);
+    std::lock_guard lock{m};
+    remember(key, {freq, std::make_shared<SampleData const>(std::move(pcm))});
+}
+
+void SpeechCache::save(
+    std::string const& key, float freq, std::vector<int16_t> const& pcm)
+{
+    // Write to a temporary file and rename, so a reader never sees a
+    // partial file
+    auto name = file_for(dir, key);
+    auto temp = fs::path(name).replace_extension(".tmp");
+    {
+        std::ofstream out{temp, std::ios::binary};
+        if (!out) { return; }
+        Header header{};
+        std::memcpy(header.magic, magic, 4);
+        header.freq = static_cast<uint32_t>(freq);
+        header.frames = static_cast<uint32_t>(pcm.size());
+        header.key_size = static_cast<uint32_t>(key.size());
+        out.write(reinterpret_cast<char const*>(&header), sizeof(Header));
+        out.write(key.data(), static_cast<std::streamsize>(key.size()));
+        out.write(reinterpret_cast<char const*>(pcm.data()),
+            static_cast<std::streamsize>(pcm.size() * sizeof(int16_t)));
+    }
+    std::error_code ec;
+    fs::rename(temp, name, ec);
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "samples.hpp"
+
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Synthesized phrases, addressed by voice, text and rate.
+// Recently used phrases are kept in memory. All phrases are also stored
+// on disk as 16 bit PCM, and read back from there in later runs.
+// Used from both the main thread and the speech thread.
+class SpeechCache
+{
+public:
+    // Always 16 bit
+    struct Entry
+    {
+        float freq = 0;
+        std::shared_ptr<SampleData const> samples;
+    };
+
+    explicit SpeechCache(std::filesystem::path dir, size_t capacity = 64);
+
+    static std::string key(
+        std::string const& voice, std::string const& text, float rate);
+
+    // Look in memory first, then on disk
+    std::optional<Entry> get(std::string const& key);
+
+    void put(std::string const& key, float freq, std::vector<int16_t>&& pcm);
+
+private:
+    using Lru = std::list<std::pair<std::string, Entry>>;
+
+    std::filesystem::path dir;
+    size_t capacity;
+
+    std::mutex m;
+    Lru lru;
+    std::unordered_map<std::string, Lru::iterator> index;
+
+    void remember(std::string const& key, Entry const& entry);
+    std::optional<Entry> load(std::string const& key);
+    void save(std::string const& key, float freq,
+        std::vector<int16_t> const& pcm);
+};
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+enum class Wave
+{
+    Sine,
+    Square,
+    Saw,
+    Triangle,
+    Noise
+};
+
+enum class FilterType
+{
+    None,
+    LowPass,
+    HighPass,
+    BandPass
+};
+
+// Describes how a synth voice sounds. Plain data so it can be copied
+// into audio commands.
+struct Patch
+{
+    Wave wave = Wave::Square;
+    float pulse_width = 0.5F;
+
+    // Envelope; times in seconds, sustain is a level
+    float attack = 0.01F;
+    float decay = 0.1F;
+    float sustain = 0.7F;
+    float release = 0.2F;
+
+    FilterType filter = FilterType::None;
+    float cutoff = 2000.0F;
+    float resonance = 0.0F;
+
+    float volume = 0.5F;
+};
+
+// A single oscillator with an ADSR envelope and a state variable filter
+class SynthVoice
+{
+    enum class Stage
+    {
+        Off,
+        Attack,
+        Decay,
+        Sustain,
+        Release
+    };
+
+    static constexpr float rate = 44100.0F;
+    static constexpr float pi = 3.14159265F;
+
+    Patch patch;
+    Stage stage = Stage::Off;
+    float level = 0;
+    float attack_step = 0;
+    float decay_step = 0;
+    float release_step = 0;
+
+    float phase = 0;
+    float step = 0;
+    float gain = 0;
+
+    uint32_t noise_seed = 0x12345;
+    float noise = 0;
+
+    // Filter state
+    float f = 0;
+    float damp = 0;
+    float low = 0;
+    float band = 0;
+
+    // Noise changes value once per period, so it needs a much higher
+    // rate than the note to sound like noise
+    float step_for(float freq) const
+    {
+        return freq / rate * (patch.wave == Wave::Noise ? 16.0F : 1.0F);
+    }
+
+    static float rate_for(float seconds, float distance)
+    {
+        return seconds <= 0 ? distance : distance / (seconds * rate);
+    }
+
+    float oscillator()
+    {
+        switch (patch.wave) {
+        case Wave::Sine: return std::sin(phase * 2 * pi);
+        case Wave::Square: return phase < patch.pulse_width ? 1.0F : -1.0F;
+        case Wave::Saw: return phase * 2 - 1;
+        case Wave::Triangle: return 4 * std::abs(phase - 0.5F) - 1;
+        case Wave::Noise: return noise;
+        }
+        return 0;
+    }
+
+    void next_noise()
+    {
+        // xorshift32
+        noise_seed ^= noise_seed << 13U;
+        noise_seed ^= noise_seed >> 17U;
+        noise_seed ^= noise_seed << 5U;
+        noise = static_cast<float>(noise_seed & 0xffffU) / 32768.0F - 1.0F;
+    }
+
+    float envelope()
+    {
+        switch (stage) {
+        case Stage::Off: return 0;
+        case Stage::Attack:
+            level += attack_step;
+            if (level >= 1.0F) {
+                level = 1.0F;
+                stage = Stage::Decay;
+            }
+            break;
+        case Stage::Decay:
+            level -= decay_step;
+            if (level <= patch.sustain) {
+                level = patch.sustain;
+                stage = Stage::Sustain;
+            }
+            break;
+        case Stage::Sustain: break;
+        case Stage::Release:
+            level -= release_step;
+            if (level <= 0) {
+                level = 0;
+                stage = Stage::Off;
+            }
+            break;
+        }
+        return level;
+    }
+
+    float filter(float in)
+    {
+        if (patch.filter == FilterType::None) { return in; }
+        low += f * band;
+        float high = in - low - damp * band;
+        band += f * high;
+        switch (patch.filter) {
+        case FilterType::LowPass: return low;
+        case FilterType::HighPass: return high;
+        case FilterType::BandPass: return band;
+        case FilterType::None: break;
+        }
+        return in;
+    }
+
+public:
+    bool active() const { return stage != Stage::Off; }
+
+    void note_on(Patch const& p, float freq, float velocity)
+    {
+        patch = p;
+        step = step_for(freq);
+        gain = velocity * patch.volume;
+        // Keep phase and level of a playing voice to avoid clicks
+        if (stage == Stage::Off) {
+            phase = 0;
+            level = 0;
+            low = band = 0;
+        }
+        stage = Stage::Attack;
+        attack_step = rate_for(patch.attack, 1.0F);
+        decay_step = rate_for(patch.decay, 1.0F - patch.sustain);
+        // Chamberlin filter is only stable up to about rate/6
+        auto cutoff = std::clamp(patch.cutoff, 20.0F, rate / 6);
+        f = 2 * std::sin(pi * cutoff / rate);
+        damp = 2 * (1 - std::clamp(patch.resonance, 0.0F, 0.95F));
+    }
+
+    void note_off()
+    {
+        if (stage != Stage::Off) {
+            release_step = rate_for(patch.release, std::max(level, 0.01F));
+            stage = Stage::Release;
+        }
+    }
+
+    void stop() { stage = Stage::Off; }
+
+    void set_freq(float freq) { step = step_for(freq); }
+
+    float read()
+    {
+        auto env = envelope();
+        if (stage == Stage::Off) { return 0; }
+        auto out = filter(oscillator()) * env * gain;
+        phase += step;
+        if (phase >= 1.0F) {
+            phase -= std::floor(phase);
+            if (patch.wave == Wave::Noise) { next_noise(); }
+        }
+        return out;
+    }
+};
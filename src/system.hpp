@@ -4,6 +4,7 @@
 #include "settings.hpp"
 
 #include <functional>
+#include <memory>
 #include <tuple>
 #include <unordered_map>
 #include <variant>
@@ -62,6 +63,8 @@ public:
     virtual AnyEvent poll_events() { return NoEvent{}; }
     virtual void set_audio_callback(std::function<void(float*, size_t)> const&)
     {}
+    // Number of times the audio device ran out of data
+    virtual int audio_underruns() { return 0; }
 
     virtual void init_input(Settings const&) {}
 
@@ -70,3 +73,6 @@ public:
 
 std::unique_ptr<System> create_sdl_system();
 std::unique_ptr<System> create_pi_system();
+// Wrap `system` so audio is rendered to `settings.audio_out`
+std::unique_ptr<System> create_file_audio_system(
+    std::unique_ptr<System> system, Settings const& settings);
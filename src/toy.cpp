@@ -3,12 +3,22 @@
 
 #include <mruby.h>
 #include <mruby/compile.h>
+#include <mruby/dump.h>
+#include <mruby/irep.h>
+#include <mruby/proc.h>
 #include <mruby/value.h>
+#include <mruby/version.h>
 
+#include <gl/program_registry.hpp>
 #include <pix/pixel_console.hpp>
 
+#include "embedded_scripts.hpp"
 #include "error.hpp"
+#include "frame_timer.hpp"
+#include "gc_pacer.hpp"
+#include "hash.hpp"
 #include "mrb_tools.hpp"
+#include "profiler.hpp"
 #include "raudio.hpp"
 #include "rcanvas.hpp"
 #include "rconsole.hpp"
@@ -21,6 +31,7 @@
 #include "rtimer.hpp"
 
 #include <chrono>
+#include <cstring>
 #include <coreutils/split.h>
 #include <filesystem>
 #include <fstream>
@@ -71,14 +82,23 @@ void Toy::init()
 #else
     system = create_sdl_system();
 #endif
+    if (!settings.audio_out.empty()) {
+        system = create_file_audio_system(std::move(system), settings);
+    }
 
     data_root = find_data_root();
     if(data_root.empty()) {
         exit(1);
     }
     fs::current_path(data_root);
-    fs::copy(
-        "sys/help.rb", "ruby/help.rb", fs::copy_options::overwrite_existing);
+
+    embedded_sys = settings.sys_dir.empty();
+    if (!embedded_sys) { ruby_path = "ruby:" + settings.sys_dir.string(); }
+
+    mrb_cache_dir = settings.cache_dir / "mrb";
+    std::error_code ec;
+    fs::create_directories(mrb_cache_dir, ec);
+    gl_wrap::ProgramRegistry::get().cache_dir = settings.cache_dir / "gl";
 
     RLayer::reg_class(ruby);
     RConsole::reg_class(ruby);
@@ -90,7 +110,10 @@ void Toy::init()
     RSprites::reg_class(ruby);
     RTimer::reg_class(ruby);
     RAudio::reg_class(ruby, *system, settings);
-    RSpeech::reg_class(ruby);
+    RSpeech::reg_class(ruby, settings);
+    GcPacer::reg_class(ruby, settings.gc_budget);
+    FrameTimer::reg_class(ruby);
+    Profiler::reg_class(ruby);
 
     fmt::print("SYSTEM: {}\n", settings.system);
     auto* rclass = mrb_define_class(ruby, "Settings", nullptr);
@@ -151,6 +174,10 @@ void Toy::init()
             auto [name] = mrb::get_args<std::string>(mrb);
             fmt::print("Require {}\n", name);
 
+            if (embedded_sys && require_embedded(mrb, name)) {
+                return mrb_nil_value();
+            }
+
             auto parts = utils::split(ruby_path, ":"s);
             std::optional<fs::path> to_load;
             for (auto const& part : parts) {
@@ -178,19 +205,10 @@ void Toy::init()
             }
             already_loaded[rb_file.string()] = modified;
 
-            FILE* fp = fopen(rb_file.string().c_str(), "rb");
-            if (fp != nullptr) {
-                auto* ctx = mrbc_context_new(mrb);
-                ctx->capture_errors = true;
-                mrbc_filename(mrb, ctx, name.c_str());
-                ctx->lineno = 1;
-                mrb_load_file_cxt(mrb, fp, ctx);
-                mrbc_context_free(mrb, ctx);
-                fclose(fp);
-                if (auto err = mrb::check_exception(mrb)) {
-                    fmt::print("REQUIRE Error: {}\n", *err);
-                    exit(1);
-                }
+            load_file(mrb, rb_file, name);
+            if (auto err = mrb::check_exception(mrb)) {
+                fmt::print("REQUIRE Error: {}\n", *err);
+                exit(1);
             }
             return mrb_nil_value();
         },
@@ -219,6 +237,159 @@ void Toy::init()
         MRB_ARGS_REQ(1));
 }
 
+// Cached bytecode is named from the file path, so a new version replaces
+// the old file. It starts with a key made from the modification time and
+// the mruby version, and any change means it is stale.
+static fs::path cache_file_for(fs::path const& dir, fs::path const& rb_file)
+{
+    auto name = rb_file.string();
+    return dir / fmt::format("{:016x}.mrb", fnv1a(name.data(), name.size()));
+}
+
+static uint64_t cache_key(fs::path const& rb_file)
+{
+    auto modified = fs::last_write_time(rb_file).time_since_epoch().count();
+    auto key = fmt::format("{}:{}", modified, MRUBY_VERSION);
+    return fnv1a(key.data(), key.size());
+}
+
+// Returns false if there is no usable bytecode, and the file should be
+// compiled instead. Exceptions raised by the script are left in `mrb`.
+bool Toy::load_cached(mrb_state* mrb, path const& rb_file)
+{
+    auto cache_file = cache_file_for(mrb_cache_dir, rb_file);
+    std::ifstream in{cache_file, std::ios::binary};
+    if (!in) { return false; }
+    std::vector<uint8_t> bin{std::istreambuf_iterator<char>(in), {}};
+    uint64_t key = 0;
+    if (bin.size() <= sizeof(key)) { return false; }
+    memcpy(&key, bin.data(), sizeof(key));
+    if (key != cache_key(rb_file)) { return false; }
+
+    auto* irep = mrb_read_irep_buf(
+        mrb, bin.data() + sizeof(key), bin.size() - sizeof(key));
+    if (irep == nullptr) {
+        // Truncated, or from an incompatible mruby
+        std::error_code ec;
+        fs::remove(cache_file, ec);
+        return false;
+    }
+    auto* proc = mrb_proc_new(mrb, irep);
+    mrb_irep_decref(mrb, irep);
+    MRB_PROC_SET_TARGET_CLASS(proc, mrb->object_class);
+    mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+    return true;
+}
+
+void Toy::compile_and_load(
+    mrb_state* mrb, path const& rb_file, std::string const& name)
+{
+    FILE* fp = fopen(rb_file.string().c_str(), "rb");
+    if (fp == nullptr) { return; }
+    auto* ctx = mrbc_context_new(mrb);
+    ctx->capture_errors = true;
+    mrbc_filename(mrb, ctx, name.c_str());
+    ctx->lineno = 1;
+    auto* parser = mrb_parse_file(mrb, fp, ctx);
+    if (parser == nullptr || parser->nerr > 0) {
+        // Let mruby load it again to raise the proper syntax error
+        if (parser != nullptr) { mrb_parser_free(parser); }
+        rewind(fp);
+        mrb_load_file_cxt(mrb, fp, ctx);
+        mrbc_context_free(mrb, ctx);
+        fclose(fp);
+        return;
+    }
+    fclose(fp);
+    auto* proc = mrb_generate_code(mrb, parser);
+    mrb_parser_free(parser);
+    mrbc_context_free(mrb, ctx);
+    if (proc == nullptr) { return; }
+
+    uint8_t* bin = nullptr;
+    size_t bin_size = 0;
+    if (mrb_dump_irep(mrb, proc->body.irep, MRB_DUMP_DEBUG_INFO, &bin,
+            &bin_size) == MRB_DUMP_OK) {
+        // Write to a temporary file first, a partial cache file would
+        // crash the next load
+        auto cache_file = cache_file_for(mrb_cache_dir, rb_file);
+        auto temp = fs::path(cache_file).replace_extension(".tmp");
+        {
+            auto key = cache_key(rb_file);
+            std::ofstream out{temp, std::ios::binary};
+            out.write(reinterpret_cast<char const*>(&key), sizeof(key));
+            out.write(reinterpret_cast<char const*>(bin),
+                static_cast<std::streamsize>(bin_size));
+        }
+        std::error_code ec;
+        fs::rename(temp, cache_file, ec);
+        mrb_free(mrb, bin);
+    }
+
+    MRB_PROC_SET_TARGET_CLASS(proc, mrb->object_class);
+    mrb_top_run(mrb, proc, mrb_top_self(mrb), 0);
+}
+
+void Toy::load_file(
+    mrb_state* mrb, path const& rb_file, std::string const& name)
+{
+    auto start = clk::now();
+    bool cached = load_cached(mrb, rb_file);
+    if (!cached) { compile_and_load(mrb, rb_file, name); }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        clk::now() - start)
+                  .count();
+    fmt::print("Loaded {} in {:.2f}ms ({})\n", name,
+        static_cast<double>(us) / 1000.0, cached ? "cached" : "compiled");
+}
+
+bool Toy::require_embedded(mrb_state* mrb, std::string const& name)
+{
+    auto file_name = name;
+    if (fs::path(name).extension() == "") { file_name += ".rb"; }
+    auto const* irep = find_embedded_script(file_name);
+    if (irep == nullptr) { return false; }
+
+    auto key = "embedded:" + file_name;
+    if (already_loaded.count(key) > 0) {
+        fmt::print("{} already loaded\n", key);
+        return true;
+    }
+    already_loaded[key] = {};
+
+    auto start = clk::now();
+    mrb_load_irep(mrb, irep);
+    if (auto err = mrb::check_exception(mrb)) {
+        fmt::print("REQUIRE Error: {}\n", *err);
+        exit(1);
+    }
+    auto us = std::chrono::duration_cast<std::chrono::microseconds>(
+        clk::now() - start)
+                  .count();
+    fmt::print("Loaded {} in {:.2f}ms (embedded)\n", name,
+        static_cast<double>(us) / 1000.0);
+    return true;
+}
+
+void Toy::load_main()
+{
+    Settings defaults;
+    if (settings.boot_script == defaults.boot_script) {
+        if (embedded_sys) {
+            if (auto const* irep = find_embedded_script("main.rb")) {
+                mrb_load_irep(ruby, irep);
+                return;
+            }
+        } else {
+            std::ifstream ruby_file{settings.sys_dir / "main.rb"};
+            exec(ruby, read_all(ruby_file));
+            return;
+        }
+    }
+    std::ifstream ruby_file{settings.boot_script};
+    exec(ruby, read_all(ruby_file));
+}
+
 void Toy::exec(mrb_state* mrb, std::string const& code)
 {
     auto* ctx = mrbc_context_new(mrb);
@@ -259,19 +430,43 @@ void Toy::exec(mrb_state* mrb, std::string const& code)
 
 void Toy::destroy()
 {
+    if (!settings.profile_file.empty()) {
+        auto* prof = Profiler::default_profiler;
+        prof->stop();
+        prof->write_folded(settings.profile_file);
+        fmt::print("{}", prof->top(30));
+    }
+    Display::default_display->release_layers();
     mrb_close(ruby);
     ruby = nullptr;
 }
 
 bool Toy::render_loop()
 {
-    RAudio::default_audio->update();
+    auto* timer = FrameTimer::default_timer;
+    timer->begin_frame();
+    auto* pacer = GcPacer::default_pacer;
+    pacer->begin_frame();
+
+    {
+        auto t = timer->scope("audio");
+        RAudio::default_audio->update();
+        if (RSpeech::default_speech != nullptr) {
+            RSpeech::default_speech->update();
+        }
+    }
 
     auto* display = Display::default_display;
     // auto seconds = get_seconds();
     auto* input = RInput::default_input;
-    if (display->begin_draw()) { return true; }
-    if ((input != nullptr) && input->update()) { return true; }
+    {
+        auto t = timer->scope("draw");
+        if (display->begin_draw()) { return true; }
+    }
+    {
+        auto t = timer->scope("input");
+        if ((input != nullptr) && input->update()) { return true; }
+    }
 
     if (!ErrorState::stack.empty()) {
         auto e = ErrorState::stack.back();
@@ -283,6 +478,9 @@ bool Toy::render_loop()
         if (RTimer::default_timer != nullptr) {
             RTimer::default_timer->reset();
         }
+        if (RSpeech::default_speech != nullptr) {
+            RSpeech::default_speech->reset();
+        }
         display->console->clear();
         display->console->text(0, 0, e.text);
         int y = 2;
@@ -295,10 +493,10 @@ bool Toy::render_loop()
         display->reset();
         input->reset();
         RTimer::default_timer->reset();
-        std::ifstream ruby_file;
-        ruby_file.open("sys/main.rb");
-        auto source = read_all(ruby_file);
-        mrb_load_string(ruby, source.c_str());
+        if (RSpeech::default_speech != nullptr) {
+            RSpeech::default_speech->reset();
+        }
+        load_main();
     }
 
     auto [mx, my] = input->mouse_pos();
@@ -308,12 +506,22 @@ bool Toy::render_loop()
         display->mouse_cursor->dirty = true;
     }
 
-    if (RTimer::default_timer != nullptr) { RTimer::default_timer->update(); }
+    if (RTimer::default_timer != nullptr) {
+        auto t = timer->scope("timers");
+        RTimer::default_timer->update();
+    }
 
-    display->end_draw();
-    display->swap();
+    {
+        auto t = timer->scope("render");
+        display->end_draw();
+    }
+    {
+        auto t = timer->scope("swap");
+        display->swap();
+    }
 
     if (!to_run.empty()) {
+        auto t = timer->scope("run");
         fmt::print("Running\n");
         mrb_load_string(ruby, to_run.c_str());
         if (auto err = mrb::check_exception(ruby)) {
@@ -324,6 +532,11 @@ bool Toy::render_loop()
         to_run.clear();
     }
 
+    {
+        auto t = timer->scope("gc");
+        pacer->end_frame();
+    }
+    timer->end_frame();
     return false;
 }
 
@@ -349,11 +562,42 @@ int Toy::run()
         return 0;
     }
 
+    if (settings.dispatch_benchmark) {
+        // Cost of delivering one event to an empty ruby handler
+        auto handler = mrb_load_string(ruby, "proc { |x, y| }");
+        constexpr int count = 1000000;
+        auto start = clk::now();
+        for (int i = 0; i < count; i++) {
+            call_proc(ruby, handler, i, i);
+        }
+        auto secs =
+            std::chrono::duration<double>(clk::now() - start).count();
+        fmt::print("{} dispatches in {:.3f}s ({:.0f}/s)\n", count, secs,
+            count / secs);
+        // A raising handler must end up on the error stack, not unwind
+        // past us
+        auto raising = mrb_load_string(ruby, "proc { |x, y| raise 'x' }");
+        auto errors = ErrorState::stack.size();
+        bool failed = call_proc(ruby, raising, 1, 2);
+        if (!failed || ErrorState::stack.size() != errors + 1) {
+            fmt::print("Raising handler was not caught\n");
+            return 1;
+        }
+        ErrorState::stack.pop_back();
+        return 0;
+    }
+
+    if (!settings.profile_file.empty()) {
+        if (Profiler::available()) {
+            Profiler::default_profiler->start();
+        } else {
+            fmt::print("Profiling needs mruby built with MRB_USE_DEBUG_HOOK\n");
+        }
+    }
+
     puts("Main");
-    std::ifstream ruby_file;
-    ruby_file.open(settings.boot_script);
-    auto source = read_all(ruby_file);
-    exec(ruby, source);
+    auto boot_start = clk::now();
+    load_main();
     if (auto err = mrb::check_exception(ruby)) {
         fmt::print("START Error: {}\n", *err);
         for (auto&& line : mrb::get_backtrace(ruby)) {
@@ -361,7 +605,10 @@ int Toy::run()
         }
         exit(1);
     }
-    puts("Loaded");
+    fmt::print("Loaded in {}ms\n",
+        std::chrono::duration_cast<std::chrono::milliseconds>(
+            clk::now() - boot_start)
+            .count());
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop_arg(
         [](void* data) {
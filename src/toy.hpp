@@ -47,10 +47,23 @@ class Toy
     using path = std::filesystem::path;
 
     static inline std::string ruby_path = "ruby:sys";
+    // Require system scripts from the bytecode linked into the binary
+    static inline bool embedded_sys = true;
+    // Compiled bytecode of required files
+    static inline std::filesystem::path mrb_cache_dir;
     static inline std::unordered_map<std::string,
         std::filesystem::file_time_type>
         already_loaded;
 
+    static bool load_cached(mrb_state* mrb, path const& rb_file);
+    static void compile_and_load(
+        mrb_state* mrb, path const& rb_file, std::string const& name);
+    static void load_file(
+        mrb_state* mrb, path const& rb_file, std::string const& name);
+    // Returns false if `name` is not an embedded script
+    static bool require_embedded(mrb_state* mrb, std::string const& name);
+    void load_main();
+
 public:
     explicit Toy(Settings const& settings);
 
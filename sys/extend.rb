@@ -171,6 +171,8 @@ end
 class Audio
     extend MethAttrs
     returns! Sound, :load_wav
+    returns! Stream, :stream
+    returns! Tracker, :load_music
 
 end
 
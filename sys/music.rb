@@ -22,7 +22,6 @@ class Music
     def initialize()
         @audio = Audio.default
         @sound = Audio.load_wav("data/piano.wav")
-        @channel = 0
         @tempo = 0.2
     end 
 
@@ -38,26 +37,27 @@ class Music
 
     def current_sound() @sound ; end
 
+    # Queue up notes, one per beat (@tempo seconds). An array plays a chord,
+    # and :p is a pause. Times are kept in seconds and only turned into
+    # beats of the shared audio tempo when scheduling, so the tempo is left
+    # alone and changing it does not move notes still to be queued.
     def play(*notes)
+        now = @audio.time
+        beats_per_sec = @audio.tempo / 60.0
+        # Start 100ms ahead so the first note is not late
+        t = [now + 0.1, @next_time || 0].max
         notes.each do |note|
             unless note == :p
-                if note.class == Array
-                    note.each do |n|
-                        @audio.play(@channel, @sound, ALL_KEYS[n])
-                        @channel += @sound.channels
-                        @channel = 0 if @channel == 32
-                    end
-                else
-                    @audio.play(@channel, @sound, ALL_KEYS[note])
-                    @channel += @sound.channels
-                    @channel = 0 if @channel == 32
+                beat = @audio.beat + (t - now) * beats_per_sec
+                (note.class == Array ? note : [note]).each do |n|
+                    @audio.schedule(beat, @sound, ALL_KEYS[n], 1.0,
+                                    @tempo * beats_per_sec)
                 end
             end
-            # TODO: Queue up notes instead
-            # OS.sleep @tempo
+            t += @tempo
         end
+        @next_time = t
     end
 
-
 end
 
@@ -100,6 +100,16 @@ module OS
 
     module_function :on_draw, :on_key, :on_drag, :on_click, :on_timer, :vec2, :remove_handler
 
+    doc! "Profile the given block. Writes collapsed stacks to `file` and shows the `top` hottest frames"
+    def self.profile(file = 'profile.folded', top = 20)
+        Profiler.start
+        begin
+            yield
+        ensure
+            puts Profiler.stop(file, top)
+        end
+    end
+
     def self.reset_handlers
         p "HANDLERS"
         @@handlers = Handlers.new
@@ -266,6 +276,9 @@ module OS
 
     def help(what = nil)
         if what == 'tutorial'
+            # Start from a fresh copy, so the snippets work as described
+            text = File.read('sys/help.rb')
+            File.open('ruby/help.rb', 'w') { |f| f.write(text) }
             ed = Editor.new
             ed.load('ruby/help.rb')
             ed.run_editor
@@ -34,9 +34,8 @@ module Shortcuts
     def speech() Speech.default end
 
     doc! "Use text to speech to vocalize the given text"
-    def say(text)
-        sound = Speech.default.text_to_sound(text)
-        audio.play(sound)
+    def say(text, &block)
+        Speech.default.say_async(text, &block)
     end
 
     doc! "Play a sound at default or given frequency"